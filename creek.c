@@ -28,6 +28,11 @@
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#include <stdint.h>
+
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
 
 #include "puzzles.h"
 
@@ -221,43 +226,648 @@ static const char *validate_params(const game_params *params, bool full)
     return NULL;
 }
 
+/*
+ * Articulation-point view of the non-black cells. The solver keeps
+ * asking "would blackening this undecided cell cut the white region
+ * apart?", once for every candidate in a pass; rather than rebuilding
+ * a dsf for each candidate, we do one depth-first search from the
+ * first white cell and answer each question from the DFS tree.
+ *
+ * The adjacency rules are those of check_connectedness_creek() at the
+ * given level, and creek_conn_blacken_ok() returns exactly what that
+ * function would return with the given undecided cell set to black.
+ * The structure describes one particular grid, so every change to the
+ * grid must be reported to creek_conn_update(). Most changes leave the
+ * set of non-black cells reachable from the root alone: a cell turning
+ * white only adds to the white counts, and a cell turning black
+ * outside the root's component removes nothing the search saw. Only
+ * the remaining changes throw the search away, to be redone by the
+ * next creek_conn_build().
+ */
+struct creek_conn {
+    int w, h, level;
+    bool valid;
+    bool whites_split;           /* some white cell unreachable from the root */
+    int nfail;                   /* clue points failing the DIFF_HARD check */
+    int first_white, root;
+    int *disc, *low, *last;      /* preorder, lowpoint, last preorder in subtree */
+    int *parent, *wsub;          /* DFS parent, white cells in subtree */
+    int *need, *co;              /* per clue point, for the DIFF_HARD check */
+    int *stack;
+    unsigned char *dir;
+};
+
+static void init_conn_creek(struct creek_conn *cc, int w, int h) {
+    int W = w+1, H = h+1;
+    cc->w = w;
+    cc->h = h;
+    cc->valid = false;
+    cc->disc = snewn(w*h, int);
+    cc->low = snewn(w*h, int);
+    cc->last = snewn(w*h, int);
+    cc->parent = snewn(w*h, int);
+    cc->wsub = snewn(w*h, int);
+    cc->need = snewn(W*H, int);
+    cc->co = snewn(W*H, int);
+    cc->stack = snewn(w*h, int);
+    cc->dir = snewn(w*h, unsigned char);
+}
+
+static void free_conn_creek(struct creek_conn *cc) {
+    sfree(cc->disc);
+    sfree(cc->low);
+    sfree(cc->last);
+    sfree(cc->parent);
+    sfree(cc->wsub);
+    sfree(cc->need);
+    sfree(cc->co);
+    sfree(cc->stack);
+    sfree(cc->dir);
+}
+
+static void creek_conn_invalidate(struct creek_conn *cc) {
+    cc->valid = false;
+}
+
+static void stat_clue_conn_creek(struct creek_conn *cc,
+                                 const signed char *soln,
+                                 const signed char *clues, int x, int y);
+
+/* Cell j has just changed from old to soln[j]. */
+static void creek_conn_update(struct creek_conn *cc, const signed char *soln,
+                              const signed char *clues, int j, int old) {
+    int w = cc->w, x = j % w, y = j / w, u;
+
+    if (!cc->valid)
+        return;
+    if (old != 0 || cc->first_white < 0) {
+        creek_conn_invalidate(cc);
+        return;
+    }
+    if (cc->disc[j] < 0) {
+        /* A black cell out of reach changes nothing; a white one
+         * splits the whites, and the search should start afresh. */
+        if (soln[j] < 0)
+            creek_conn_invalidate(cc);
+        return;
+    }
+    if (soln[j] > 0) {
+        creek_conn_invalidate(cc);
+        return;
+    }
+
+    /* A reachable cell turning white: the graph is unchanged. */
+    for (u = j; u >= 0; u = cc->parent[u])
+        cc->wsub[u]++;
+    if (j < cc->first_white)
+        cc->first_white = j;
+    if (cc->level > DIFF_TRICKY) {
+        stat_clue_conn_creek(cc, soln, clues, x, y);
+        stat_clue_conn_creek(cc, soln, clues, x+1, y);
+        stat_clue_conn_creek(cc, soln, clues, x, y+1);
+        stat_clue_conn_creek(cc, soln, clues, x+1, y+1);
+    }
+}
+
+/*
+ * Neighbour of cell g in direction dir (left, up, right, down), or -1
+ * if there is none or, above DIFF_EASY, the clues forbid a white path
+ * across the shared edge.
+ */
+static int creek_conn_neighbour(int w, int h, const signed char *clues,
+                                int level, int g, int dir) {
+    int W = w+1, x = g % w, y = g / w;
+    int cul = y*W+x, cur = y*W+(x+1), cdl = (y+1)*W+x, cdr = (y+1)*W+(x+1);
+
+    switch (dir) {
+      case 0:
+        if (x == 0) return -1;
+        if (level > DIFF_EASY &&
+            (clues[cul] == 3 || clues[cdl] == 3 ||
+             (y == 0 && clues[cul] == 1) || (y == h-1 && clues[cdl] == 1)))
+            return -1;
+        return g-1;
+      case 1:
+        if (y == 0) return -1;
+        if (level > DIFF_EASY &&
+            (clues[cul] == 3 || clues[cur] == 3 ||
+             (x == 0 && clues[cul] == 1) || (x == w-1 && clues[cur] == 1)))
+            return -1;
+        return g-w;
+      case 2:
+        if (x == w-1) return -1;
+        if (level > DIFF_EASY &&
+            (clues[cur] == 3 || clues[cdr] == 3 ||
+             (y == 0 && clues[cur] == 1) || (y == h-1 && clues[cdr] == 1)))
+            return -1;
+        return g+1;
+      default:
+        if (y == h-1) return -1;
+        if (level > DIFF_EASY &&
+            (clues[cdl] == 3 || clues[cdr] == 3 ||
+             (x == 0 && clues[cdl] == 1) || (x == w-1 && clues[cdr] == 1)))
+            return -1;
+        return g+w;
+    }
+}
+
+static int clue_neighbours_creek(int w, int h, int x, int y, int *neighbours) {
+    int nneigh = 0;
+    if (x > 0 && y > 0) neighbours[nneigh++] = (y-1)*w+(x-1);
+    if (x > 0 && y < h) neighbours[nneigh++] = y*w+(x-1);
+    if (x < w && y < h) neighbours[nneigh++] = y*w+x;
+    if (x < w && y > 0) neighbours[nneigh++] = (y-1)*w+x;
+    return nneigh;
+}
+
+/*
+ * Work out how many reachable non-black neighbours clue point (x,y)
+ * has and how many it needs, if it still needs white neighbours at
+ * all, keeping the count of failing clue points up to date.
+ */
+static void stat_clue_conn_creek(struct creek_conn *cc,
+                                 const signed char *soln,
+                                 const signed char *clues, int x, int y) {
+    int w = cc->w, h = cc->h, W = w+1, k = y*W+x;
+    int c, i, nw, nneigh;
+    int neighbours[4];
+
+    if (cc->need[k] >= 0 && cc->co[k] < cc->need[k])
+        cc->nfail--;
+    cc->need[k] = -1;
+    if ((c = clues[k]) < 0)
+        return;
+
+    nneigh = clue_neighbours_creek(w, h, x, y, neighbours);
+    nw = 0;
+    for (i = 0; i < nneigh; i++)
+        if (soln[neighbours[i]] == -1) nw++;
+    if (nw >= nneigh-c)
+        return;
+
+    cc->need[k] = nneigh-c;
+    cc->co[k] = 0;
+    for (i = 0; i < nneigh; i++)
+        if (cc->disc[neighbours[i]] >= 0) cc->co[k]++;
+    if (cc->co[k] < cc->need[k])
+        cc->nfail++;
+}
+
+static void creek_conn_build(struct creek_conn *cc, const signed char *soln,
+                             const signed char *clues, int level) {
+    int w = cc->w, h = cc->h, W = w+1, H = h+1;
+    int i, sp, t, u, v, x, y;
+
+    if (cc->valid && cc->level == level)
+        return;
+    cc->valid = true;
+    cc->level = level;
+    cc->whites_split = false;
+    cc->nfail = 0;
+
+    cc->first_white = -1;
+    for (i = 0; i < W*H; i++)
+        cc->need[i] = -1;
+    for (i = 0; i < w*h; i++) {
+        cc->disc[i] = -1;
+        if (soln[i] < 0 && cc->first_white < 0)
+            cc->first_white = i;
+    }
+    if (cc->first_white < 0)
+        return;
+
+    /* Iterative Tarjan DFS over the non-black cells. */
+    t = 0;
+    sp = 0;
+    v = cc->root = cc->first_white;
+    cc->disc[v] = cc->low[v] = t++;
+    cc->parent[v] = -1;
+    cc->wsub[v] = 1;
+    cc->dir[v] = 0;
+    cc->stack[sp++] = v;
+    while (sp > 0) {
+        v = cc->stack[sp-1];
+        if (cc->dir[v] < 4) {
+            u = creek_conn_neighbour(w, h, clues, level, v, cc->dir[v]++);
+            if (u < 0 || soln[u] > 0)
+                continue;
+            if (cc->disc[u] < 0) {
+                cc->disc[u] = cc->low[u] = t++;
+                cc->parent[u] = v;
+                cc->wsub[u] = (soln[u] < 0);
+                cc->dir[u] = 0;
+                cc->stack[sp++] = u;
+            } else if (u != cc->parent[v]) {
+                cc->low[v] = min(cc->low[v], cc->disc[u]);
+            }
+        } else {
+            sp--;
+            cc->last[v] = t-1;
+            if ((u = cc->parent[v]) >= 0) {
+                cc->low[u] = min(cc->low[u], cc->low[v]);
+                cc->wsub[u] += cc->wsub[v];
+            }
+        }
+    }
+
+    for (i = 0; i < w*h; i++)
+        if (soln[i] < 0 && cc->disc[i] < 0)
+            cc->whites_split = true;
+
+    /* Reachable neighbours around each clue that still needs whites. */
+    if (level > DIFF_TRICKY)
+        for (y = 0; y < H; y++)
+            for (x = 0; x < W; x++)
+                stat_clue_conn_creek(cc, soln, clues, x, y);
+}
+
+/*
+ * Would the grid the structure was built from still pass
+ * check_connectedness_creek() with the undecided cell j made black?
+ */
+static bool creek_conn_blacken_ok(const struct creek_conn *cc,
+                                  const signed char *clues, int j) {
+    int w = cc->w, h = cc->h, W = w+1, H = h+1;
+    int sep[4], nsep, d, i, k, u, x, y;
+
+    if (cc->first_white < 0)
+        return true;
+    if (cc->whites_split || cc->nfail > 0)
+        return false;
+    if (cc->disc[j] < 0)
+        return true;
+
+    /*
+     * Children of j whose subtrees have no back edge past j are the
+     * pieces that fall away from the first white cell (the DFS root)
+     * once j is removed. None of them may contain a white cell.
+     */
+    nsep = 0;
+    for (d = 0; d < 4; d++) {
+        u = creek_conn_neighbour(w, h, clues, cc->level, j, d);
+        if (u >= 0 && cc->disc[u] >= 0 && cc->parent[u] == j &&
+            cc->low[u] >= cc->disc[j]) {
+            if (cc->wsub[u] > 0)
+                return false;
+            sep[nsep++] = u;
+        }
+    }
+
+    if (cc->level <= DIFF_TRICKY)
+        return true;
+
+    if (nsep == 0) {
+        /* Only j itself leaves, so only the clues at its corners change. */
+        x = j % w;
+        y = j / w;
+        for (i = 0; i < 4; i++) {
+            k = (y + i/2)*W + (x + i%2);
+            if (cc->need[k] >= 0 && cc->co[k] - 1 < cc->need[k])
+                return false;
+        }
+        return true;
+    }
+
+    for (y = 0; y < H; y++)
+    for (x = 0; x < W; x++) {
+        int co, nneigh, n;
+        int neighbours[4];
+
+        k = y*W+x;
+        if (cc->need[k] < 0)
+            continue;
+
+        co = cc->co[k];
+        nneigh = clue_neighbours_creek(w, h, x, y, neighbours);
+        for (i = 0; i < nneigh; i++) {
+            u = neighbours[i];
+            if (cc->disc[u] < 0)
+                continue;
+            if (u == j) {
+                co--;
+                continue;
+            }
+            for (n = 0; n < nsep; n++)
+                if (cc->disc[u] >= cc->disc[sep[n]] &&
+                    cc->disc[u] <= cc->last[sep[n]]) {
+                    co--;
+                    break;
+                }
+        }
+        if (co < cc->need[k])
+            return false;
+    }
+    return true;
+}
+
+/*
+ * The standalone benchmark can switch the solver back to rebuilding
+ * the white-region dsf for every connectivity question, to compare
+ * against the articulation-point structure above.
+ */
+#ifdef STANDALONE_SOLVER
+static bool solver_full_rebuild = false;
+#else
+#define solver_full_rebuild false
+#endif
+
+/*
+ * Bitboard mirror of the solution grid, used by the clue-point pass to
+ * examine a whole row of clue points at once. Each cell row is one
+ * word with an off-grid cell at each end, and there is an off-grid row
+ * above and below; off-grid cells count as white, just as they do in
+ * vertex_degree_creek(). Clue point x of point row y then sees cell
+ * bits x and x+1 of padded rows y and y+1.
+ *
+ * The clue values are stored bit-sliced, as three planes per point
+ * row for c and three for 4-c, so the per-point black and white
+ * counts can be compared against them with plain word operations.
+ *
+ * The scalar clue pass in creek_solve() is the reference version;
+ * the standalone solver can switch back to it and compare the two.
+ */
+#define CREEK_BB_MAXW 62
+
+#ifdef STANDALONE_SOLVER
+static bool solver_scalar_clues = false;
+#else
+#define solver_scalar_clues false
+#endif
+
+struct creek_bits {
+    int w, h;
+    uint64_t inner;              /* padded bits of the in-grid cells */
+    uint64_t *black, *white;     /* h+2 padded cell rows */
+    uint64_t *fillb, *fillw;     /* h+2 rows of pending deductions */
+    uint64_t *has, *c[3], *k[3]; /* H point rows: clue present, c, 4-c */
+};
+
+static struct creek_bits *new_bits_creek(int w, int h) {
+    struct creek_bits *bb;
+    int i;
+
+    if (w > CREEK_BB_MAXW)
+        return NULL;
+    bb = snew(struct creek_bits);
+    bb->w = w;
+    bb->h = h;
+    bb->inner = (((uint64_t)1 << w) - 1) << 1;
+    bb->black = snewn(h+2, uint64_t);
+    bb->white = snewn(h+2, uint64_t);
+    bb->fillb = snewn(h+2, uint64_t);
+    bb->fillw = snewn(h+2, uint64_t);
+    bb->has = snewn(h+1, uint64_t);
+    for (i = 0; i < 3; i++) {
+        bb->c[i] = snewn(h+1, uint64_t);
+        bb->k[i] = snewn(h+1, uint64_t);
+    }
+    return bb;
+}
+
+static void free_bits_creek(struct creek_bits *bb) {
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        sfree(bb->c[i]);
+        sfree(bb->k[i]);
+    }
+    sfree(bb->has);
+    sfree(bb->fillw);
+    sfree(bb->fillb);
+    sfree(bb->white);
+    sfree(bb->black);
+    sfree(bb);
+}
+
+/* Empty grid, and clue planes for the given clue set. */
+static void reset_bits_creek(struct creek_bits *bb, const signed char *clues) {
+    int w = bb->w, h = bb->h, W = w+1, H = h+1;
+    int x, y, i;
+
+    for (y = 0; y < h+2; y++) {
+        bb->black[y] = 0;
+        bb->white[y] = (y == 0 || y == h+1) ? ~(uint64_t)0 : ~bb->inner;
+    }
+    for (y = 0; y < H; y++) {
+        bb->has[y] = 0;
+        for (i = 0; i < 3; i++)
+            bb->c[i][y] = bb->k[i][y] = 0;
+        for (x = 0; x < W; x++) {
+            int c = clues[y*W+x];
+            uint64_t bit = (uint64_t)1 << x;
+            if (c < 0)
+                continue;
+            bb->has[y] |= bit;
+            for (i = 0; i < 3; i++) {
+                if (c & (1 << i)) bb->c[i][y] |= bit;
+                if ((4-c) & (1 << i)) bb->k[i][y] |= bit;
+            }
+        }
+    }
+}
+
+static void put_bits_creek(struct creek_bits *bb, int j, int v) {
+    int y = j / bb->w + 1;
+    uint64_t bit = (uint64_t)1 << (j % bb->w + 1);
+
+    bb->black[y] &= ~bit;
+    bb->white[y] &= ~bit;
+    if (v > 0) bb->black[y] |= bit;
+    if (v < 0) bb->white[y] |= bit;
+}
+
+/*
+ * Bit-sliced sum of the four cells around each point of a point row,
+ * given the padded cell rows above (u) and below (d) it.
+ */
+static void count_bits_creek(uint64_t u, uint64_t d, uint64_t *n) {
+    uint64_t s = u ^ (u >> 1), c1 = u & (u >> 1);
+    uint64_t t = d ^ (d >> 1), c2 = d & (d >> 1);
+    uint64_t carry = s & t;
+
+    n[0] = s ^ t;
+    n[1] = c1 ^ c2 ^ carry;
+    n[2] = (c1 & c2) | (c1 & carry) | (c2 & carry);
+}
+
+static uint64_t eq_bits_creek(const uint64_t *a, uint64_t *const *b, int y) {
+    return ~((a[0] ^ b[0][y]) | (a[1] ^ b[1][y]) | (a[2] ^ b[2][y]));
+}
+
+/* a < b, per point; pass swap to get b < a. */
+static uint64_t lt_bits_creek(const uint64_t *a, uint64_t *const *b, int y,
+                              bool swap) {
+    uint64_t a0 = a[0], a1 = a[1], a2 = a[2];
+    uint64_t b0 = b[0][y], b1 = b[1][y], b2 = b[2][y], t;
+
+    if (swap) {
+        t = a0; a0 = b0; b0 = t;
+        t = a1; a1 = b1; b1 = t;
+        t = a2; a2 = b2; b2 = t;
+    }
+    return (~a2 & b2) |
+        (~(a2 ^ b2) & ((~a1 & b1) | (~(a1 ^ b1) & ~a0 & b0)));
+}
+
+/*
+ * Trial-and-error probes run the solver one level down on the caller's
+ * own grid, logging every cell they change on the sub-scratch's trail
+ * so that the probe can be rolled back afterwards. The top-level
+ * scratch owns one preallocated scratch per probe depth, so a probe
+ * costs neither a grid copy nor any allocation.
+ */
+#define CREEK_PROBE_DEPTH 1
+
 struct solver_scratch_creek {
     int *whitedsf;
     signed char *tmpsoln;
     const signed char *clues;
+    struct creek_conn conn;      /* adjacency at the solving difficulty */
+    struct creek_conn plain;     /* adjacency at DIFF_EASY */
+    struct creek_bits *bits;     /* shared by all probe depths, or NULL */
+    unsigned char *dirty;        /* clue point rows to re-examine */
+    int *trail;
+    signed char *trailold;
+    int ntrail;
+    struct solver_scratch_creek *sub;
     int depth;
 };
 
-static struct solver_scratch_creek *new_scratch_creek(int w, int h) {
+static struct solver_scratch_creek *new_scratch_depth_creek(
+    int w, int h, int depth, struct creek_bits *bits) {
     struct solver_scratch_creek *ret = snew(struct solver_scratch_creek);
     ret->whitedsf = snewn(w*h, int);
     ret->tmpsoln = snewn(w*h, signed char);
-    ret->depth = 0;
+    init_conn_creek(&ret->conn, w, h);
+    init_conn_creek(&ret->plain, w, h);
+    ret->bits = bits;
+    ret->dirty = snewn(h+1, unsigned char);
+    memset(ret->dirty, 1, h+1);
+    ret->trail = snewn(w*h+2, int);
+    ret->trailold = snewn(w*h+2, signed char);
+    ret->ntrail = 0;
+    ret->depth = depth;
+    ret->sub = (depth < CREEK_PROBE_DEPTH ?
+                new_scratch_depth_creek(w, h, depth+1, bits) : NULL);
     return ret;
 }
 
-static struct solver_scratch_creek *dup_scratch_creek(int w, int h, const struct solver_scratch_creek *scc) {
-    struct solver_scratch_creek *ret = snew(struct solver_scratch_creek);
-    if (scc->whitedsf != NULL) {
-        ret->whitedsf = snewn(w*h, int);
-        memcpy(ret->whitedsf, scc->whitedsf, w*h*sizeof(int));
-    }     
-    
-    if (scc->tmpsoln != NULL) {
-        ret->tmpsoln = snewn(w*h, signed char); 
-        memcpy(ret->tmpsoln, scc->tmpsoln, w*h*sizeof(signed char));
-    }
-    ret->clues = scc->clues;
-    ret->depth = scc->depth;
-    return ret;
+static struct solver_scratch_creek *new_scratch_creek(int w, int h) {
+    return new_scratch_depth_creek(w, h, 0, new_bits_creek(w, h));
 }
 
 static void free_scratch_creek(struct solver_scratch_creek *scc) {
+    if (scc->sub)
+        free_scratch_creek(scc->sub);
+    if (scc->depth == 0 && scc->bits)
+        free_bits_creek(scc->bits);
+    free_conn_creek(&scc->conn);
+    free_conn_creek(&scc->plain);
+    sfree(scc->dirty);
+    sfree(scc->trail);
+    sfree(scc->trailold);
     sfree(scc->whitedsf);
     sfree(scc->tmpsoln);
     sfree(scc);
 }
 
+static void creek_put(struct solver_scratch_creek *scc, signed char *soln,
+                      int j, int v) {
+    soln[j] = v;
+    if (scc->bits)
+        put_bits_creek(scc->bits, j, v);
+}
+
+/*
+ * Every change the solver makes goes through here: it is logged for
+ * rollback if we are inside a probe, the connectivity structures are
+ * brought up to date, and the clue points around the cell are queued
+ * for the next clue pass.
+ */
+static void creek_set(struct solver_scratch_creek *scc, signed char *soln,
+                      int j, int v) {
+    int old = soln[j], w = scc->conn.w;
+
+    if (scc->depth > 0) {
+        scc->trail[scc->ntrail] = j;
+        scc->trailold[scc->ntrail] = old;
+        scc->ntrail++;
+    }
+    creek_put(scc, soln, j, v);
+    creek_conn_update(&scc->conn, soln, scc->clues, j, old);
+    creek_conn_update(&scc->plain, soln, scc->clues, j, old);
+    scc->dirty[j / w] = scc->dirty[j / w + 1] = 1;
+}
+
+/*
+ * The clue-point pass on the bitboards: work out, for every point of
+ * a row at once, whether its clue forces the remaining cells black or
+ * white or is already violated, and apply all the deductions of the
+ * grid together, repeating until nothing changes. Only the point rows
+ * next to a cell changed since they were last examined are looked at
+ * again. The clue rules only
+ * ever fill in undecided cells, so this reaches the same grid as the
+ * scalar pass does one point at a time; two points forcing one cell
+ * opposite ways is a contradiction the scalar pass would also find.
+ */
+static bool clue_pass_bits_creek(struct solver_scratch_creek *scc,
+                                 signed char *soln) {
+    struct creek_bits *bb = scc->bits;
+    int w = bb->w, h = bb->h, H = h+1;
+    int x, y;
+    uint64_t nb[3], nw[3], fb, fw, unk;
+    bool changed;
+
+    do {
+        changed = false;
+        for (y = 0; y < h+2; y++)
+            bb->fillb[y] = bb->fillw[y] = 0;
+
+        for (y = 0; y < H; y++) {
+            uint64_t has = bb->has[y];
+            if (!scc->dirty[y])
+                continue;
+            scc->dirty[y] = 0;
+            if (!has)
+                continue;
+            count_bits_creek(bb->black[y], bb->black[y+1], nb);
+            count_bits_creek(bb->white[y], bb->white[y+1], nw);
+
+            if (has & (lt_bits_creek(nb, bb->c, y, true) |
+                       lt_bits_creek(nw, bb->k, y, true)))
+                return false;           /* impossible */
+
+            fb = has & eq_bits_creek(nw, bb->k, y) &
+                lt_bits_creek(nb, bb->c, y, false);
+            fw = has & lt_bits_creek(nw, bb->k, y, false) &
+                eq_bits_creek(nb, bb->c, y);
+            bb->fillb[y] |= fb | (fb << 1);
+            bb->fillb[y+1] |= fb | (fb << 1);
+            bb->fillw[y] |= fw | (fw << 1);
+            bb->fillw[y+1] |= fw | (fw << 1);
+        }
+
+        for (y = 1; y <= h; y++) {
+            unk = bb->inner & ~bb->black[y] & ~bb->white[y];
+            fb = bb->fillb[y] & unk;
+            fw = bb->fillw[y] & unk;
+            if (fb & fw)
+                return false;           /* impossible */
+            if (!(fb | fw))
+                continue;
+            changed = true;
+            for (x = 0; x < w; x++) {
+                if ((fb >> (x+1)) & 1)
+                    creek_set(scc, soln, (y-1)*w+x, 1);
+                else if ((fw >> (x+1)) & 1)
+                    creek_set(scc, soln, (y-1)*w+x, -1);
+            }
+        }
+    } while (changed);
+
+    return true;
+}
+
 static int vertex_degree_creek(int w, int h, signed char *soln, int x, int y,
                          bool anti, int *sx, int *sy)
 {
@@ -459,9 +1069,44 @@ static void initialize_solver_creek(int w, int h, const signed char *clues,
     memset(soln, 0, w*h);
     scc->clues = clues;
     dsf_init(scc->whitedsf, w*h);
+    memset(scc->dirty, 1, h+1);
+    if (scc->bits)
+        reset_bits_creek(scc->bits, clues);
     return;
 }
                       
+static int creek_solve(int w, int h, const signed char *clues,
+               signed char *soln, struct solver_scratch_creek *scc,
+               int difficulty);
+
+/*
+ * Tentatively set cell a (and b, if non-negative) to v, run the solver
+ * one level down on the same grid, then undo everything it changed.
+ */
+static int creek_probe(int w, int h, const signed char *clues,
+                       signed char *soln, struct solver_scratch_creek *scc,
+                       int difficulty, int a, int b, int v)
+{
+    struct solver_scratch_creek *sub = scc->sub;
+    int ret;
+
+    assert(sub && sub->ntrail == 0);
+    sub->clues = clues;
+    creek_conn_invalidate(&sub->conn);
+    creek_conn_invalidate(&sub->plain);
+    memcpy(sub->dirty, scc->dirty, h+1);
+    creek_set(sub, soln, a, v);
+    if (b >= 0)
+        creek_set(sub, soln, b, v);
+    ret = creek_solve(w, h, clues, soln, sub, difficulty);
+    while (sub->ntrail > 0) {
+        sub->ntrail--;
+        creek_put(sub, soln, sub->trail[sub->ntrail],
+                  sub->trailold[sub->ntrail]);
+    }
+    return ret;
+}
+
 static int creek_solve(int w, int h, const signed char *clues,
                signed char *soln, struct solver_scratch_creek *scc,
                int difficulty)
@@ -470,15 +1115,26 @@ static int creek_solve(int w, int h, const signed char *clues,
     int x, y, i, j;
     bool done_something;
     int firstwhite;
+    struct creek_conn *conn;
     
     if (scc->depth >= 2 && difficulty <= DIFF_TRICKY) return 3;
     
+    scc->clues = clues;
+    creek_conn_invalidate(&scc->conn);
+    creek_conn_invalidate(&scc->plain);
+    conn = (difficulty > DIFF_EASY ? &scc->conn : &scc->plain);
+
     do {
         done_something = false;
 
      /* Any clue point with the number of remaining filled boxes equal
       * to zero or to the number of remaining unfilled
       * boxes can be filled in completely. */
+        if (scc->bits && !solver_scalar_clues) {
+            /* Runs to completion, so there is no need to go round again. */
+            if (!clue_pass_bits_creek(scc, soln))
+                return 0;
+        } else
         for (y = 0; y < H; y++)
         for (x = 0; x < W; x++) {
             int c, nu, nw, nb, nneigh;
@@ -506,7 +1162,7 @@ static int creek_solve(int w, int h, const signed char *clues,
                 for (i=0;i<nneigh;i++) {
                     j = neighbours[i];
                     if (soln[j] == 0)
-                        soln[j] = 1;
+                        creek_set(scc, soln, j, 1);
                 }
                 done_something = true;
             }
@@ -514,7 +1170,7 @@ static int creek_solve(int w, int h, const signed char *clues,
                 for (i=0;i<nneigh;i++) {
                     j = neighbours[i];
                     if (soln[j] == 0)
-                        soln[j] = -1;
+                        creek_set(scc, soln, j, -1);
                 }
                 done_something = true;
             }
@@ -539,10 +1195,17 @@ static int creek_solve(int w, int h, const signed char *clues,
             if (y < h-1 && soln[(y+1)*w+x] == 0) { nneigh++; nj = (y+1)*w+x; }
             
             if (nneigh == 1) {
-                memcpy (scc->tmpsoln, soln, w*h*sizeof(signed char));
-                scc->tmpsoln[nj] = 1;
-                if (!check_connectedness_creek(w, h, scc->whitedsf, scc->tmpsoln, clues, difficulty)) {
-                    soln[nj] = -1;
+                bool ok;
+                if (solver_full_rebuild) {
+                    memcpy (scc->tmpsoln, soln, w*h*sizeof(signed char));
+                    scc->tmpsoln[nj] = 1;
+                    ok = check_connectedness_creek(w, h, scc->whitedsf, scc->tmpsoln, clues, difficulty);
+                } else {
+                    creek_conn_build(conn, soln, clues, difficulty);
+                    ok = creek_conn_blacken_ok(conn, clues, nj);
+                }
+                if (!ok) {
+                    creek_set(scc, soln, nj, -1);
                     done_something = true;
                 }
                 if (done_something) break;
@@ -583,77 +1246,49 @@ static int creek_solve(int w, int h, const signed char *clues,
                 
                 if (c == 3 && no > 0) {
                     for (i = 0;i < nneigh; i++) {
-                        int ret;
-                        struct solver_scratch_creek *tscc = dup_scratch_creek(w,h,scc);
-                        memcpy(scc->tmpsoln, soln, w*h*sizeof(signed char));
-                        tscc->depth = 1;
                         j = neighbours[i];
-                        if (soln[j] == 0) {
-                            scc->tmpsoln[j] = -1;
-                            ret = creek_solve(w,h,clues,scc->tmpsoln, tscc, difficulty);
-                            if (ret == 0) {
-                                done_something = true;
-                                soln[j] = 1;
-                            }
+                        if (soln[j] == 0 &&
+                            creek_probe(w, h, clues, soln, scc, difficulty,
+                                        j, -1, -1) == 0) {
+                            done_something = true;
+                            creek_set(scc, soln, j, 1);
                         }
-                        free_scratch_creek(tscc);
                         if (done_something) break;
                     }
                 }
 
                 if ((c == 1 || c == 2) && no > 0 && difficulty == DIFF_HARD) {
                     for (i = 0; i < nneigh; i++) {
-                        int ret;
-                        struct solver_scratch_creek *tscc = dup_scratch_creek(w,h,scc);
-                        memcpy(scc->tmpsoln, soln, w*h*sizeof(signed char));
-                        tscc->depth = 1;
                         j = neighbours[i];
-                        if (soln[j] == 0) {
-                            scc->tmpsoln[j] = 1;
-                            ret = creek_solve(w,h,clues,scc->tmpsoln, tscc, difficulty);
-                            if (ret == 0) {
-                                done_something = true;
-                                soln[j] = -1;
-                            }
+                        if (soln[j] == 0 &&
+                            creek_probe(w, h, clues, soln, scc, difficulty,
+                                        j, -1, 1) == 0) {
+                            done_something = true;
+                            creek_set(scc, soln, j, -1);
                         }
-                        free_scratch_creek(tscc);
                         if (done_something) break;
 
                         if (c == 2) {
-                            tscc = dup_scratch_creek(w,h,scc);
-                            memcpy(scc->tmpsoln, soln, w*h*sizeof(signed char));                    
-                            tscc->depth = 1;
-                            j = neighbours[i];
-                            if (soln[j] == 0) {
-                                scc->tmpsoln[j] = -1;
-                                ret = creek_solve(w,h,clues,scc->tmpsoln, tscc, difficulty);
-                                if (ret == 0) {
-                                    done_something = true;
-                                    soln[j] = 1;
-                                }
+                            if (soln[j] == 0 &&
+                                creek_probe(w, h, clues, soln, scc, difficulty,
+                                            j, -1, -1) == 0) {
+                                done_something = true;
+                                creek_set(scc, soln, j, 1);
                             }
-                            free_scratch_creek(tscc);
                             if (done_something) break;
                         }
                     }
 
                     if (c == 2 && no == 6) {
-                        int ret;
                         int r1,r2;
                         int cb[4];
-                        struct solver_scratch_creek *tscc;
                         for (i=0;i<4;i++) cb[i] = 0;
                             
                         for (r1=0;r1<3;r1++)
                         for (r2=r1+1;r2<4;r2++) {
-                            tscc = dup_scratch_creek(w,h,scc);
-                            memcpy(scc->tmpsoln, soln, w*h*sizeof(signed char));
-                            tscc->depth = 1;
-                            scc->tmpsoln[neighbours[r1]] = 1;
-                            scc->tmpsoln[neighbours[r2]] = 1;
-                            ret = creek_solve(w,h,clues,scc->tmpsoln, tscc, difficulty);
-                            free_scratch_creek(tscc);
-                            if (ret == 0) {
+                            if (creek_probe(w, h, clues, soln, scc, difficulty,
+                                            neighbours[r1], neighbours[r2],
+                                            1) == 0) {
                                 cb[r1]++;
                                 cb[r2]++;
                             }
@@ -662,8 +1297,7 @@ static int creek_solve(int w, int h, const signed char *clues,
                         for (i=0;i<4;i++) {
                             if (cb[i] == 3) {
                                 done_something = true;
-                                j = neighbours[i];
-                                soln[j] = -1;
+                                creek_set(scc, soln, neighbours[i], -1);
                             }
                         }
                     }
@@ -674,41 +1308,57 @@ static int creek_solve(int w, int h, const signed char *clues,
         if (done_something) continue;
 
         /* Fill in isolated grey areas */
-        firstwhite = -1;
-        for (i=0;i<w*h;i++)
-            if (soln[i] == -1) {
-                firstwhite = i;
-                break;
-            }
-        
-        if (firstwhite >= 0) {
-            dsf_init(scc->whitedsf, w*h);
-            for (i=0;i<w*h;i++) {
-                if (soln[i] == 1) continue;
-                x = i % w; y = i / w;
-                if (x > 0   && soln[y*w+(x-1)] != 1) dsf_merge(scc->whitedsf, i, y*w+(x-1));
-                if (x < w-1 && soln[y*w+(x+1)] != 1) dsf_merge(scc->whitedsf, i, y*w+(x+1));
-                if (y > 0   && soln[(y-1)*w+x] != 1) dsf_merge(scc->whitedsf, i, (y-1)*w+x);
-                if (y < h-1 && soln[(y+1)*w+x] != 1) dsf_merge(scc->whitedsf, i, (y+1)*w+x);                
-            }
-            
-            for (i=0;i<w*h;i++) {
-                if (soln[i] == 0) {
-                    if (dsf_canonify(scc->whitedsf, i) != dsf_canonify(scc->whitedsf, firstwhite)) {
-                        soln[i] = 1;
-                        done_something = true; 
+        if (solver_full_rebuild) {
+            firstwhite = -1;
+            for (i=0;i<w*h;i++)
+                if (soln[i] == -1) {
+                    firstwhite = i;
+                    break;
+                }
+
+            if (firstwhite >= 0) {
+                dsf_init(scc->whitedsf, w*h);
+                for (i=0;i<w*h;i++) {
+                    if (soln[i] == 1) continue;
+                    x = i % w; y = i / w;
+                    if (x > 0   && soln[y*w+(x-1)] != 1) dsf_merge(scc->whitedsf, i, y*w+(x-1));
+                    if (x < w-1 && soln[y*w+(x+1)] != 1) dsf_merge(scc->whitedsf, i, y*w+(x+1));
+                    if (y > 0   && soln[(y-1)*w+x] != 1) dsf_merge(scc->whitedsf, i, (y-1)*w+x);
+                    if (y < h-1 && soln[(y+1)*w+x] != 1) dsf_merge(scc->whitedsf, i, (y+1)*w+x);
+                }
+
+                for (i=0;i<w*h;i++) {
+                    if (soln[i] == 0) {
+                        if (dsf_canonify(scc->whitedsf, i) != dsf_canonify(scc->whitedsf, firstwhite)) {
+                            creek_set(scc, soln, i, 1);
+                            done_something = true;
+                        }
                     }
                 }
             }
+        } else {
+            /* Blackening unreachable cells leaves the search valid. */
+            creek_conn_build(&scc->plain, soln, clues, DIFF_EASY);
+            if (scc->plain.first_white >= 0)
+                for (i=0;i<w*h;i++)
+                    if (soln[i] == 0 && scc->plain.disc[i] < 0) {
+                        creek_set(scc, soln, i, 1);
+                        done_something = true;
+                    }
         }
         if (done_something) continue;
 
     } while (done_something);
 
-       /* Check if grid is connected */
-       if (!check_connectedness_creek(w, h, scc->whitedsf, soln, clues, DIFF_EASY)) {
-           return 0;
-       }
+    /* Check if grid is connected */
+    if (solver_full_rebuild) {
+        if (!check_connectedness_creek(w, h, scc->whitedsf, soln, clues, DIFF_EASY))
+            return 0;
+    } else {
+        creek_conn_build(&scc->plain, soln, clues, DIFF_EASY);
+        if (scc->plain.whites_split)
+            return 0;
+    }
 
     /* Solver can make no more progress. See if the grid is full. */
     for (i = 0; i < w*h; i++)
@@ -755,13 +1405,184 @@ static void creek_generate(int w, int h, signed char *soln, random_state *rs)
     sfree(connected);
 }
 
+/*
+ * Try removing each of the candidate clue points in turn, putting it
+ * back if the solver can no longer manage at the given difficulty.
+ */
+static void remove_clues_creek(int w, int h, int diff, signed char *clues,
+                               const int *cand, int ncand,
+                               signed char *tmpsoln,
+                               struct solver_scratch_creek *scc)
+{
+    int i, v;
+
+    for (i = 0; i < ncand; i++) {
+        v = clues[cand[i]];
+        clues[cand[i]] = -1;
+        initialize_solver_creek(w, h, clues, tmpsoln, scc, diff);
+        if (creek_solve(w, h, clues, tmpsoln, scc, diff) != 1)
+            clues[cand[i]] = v;           /* put it back */
+    }
+}
+
+#ifdef USE_PTHREADS
+/*
+ * Multi-threaded clue removal, for batch generation. The next few
+ * candidates are tried speculatively on worker threads, each against
+ * the clue set as committed so far. The results are then taken in
+ * order: every rejection before the first accepted removal is exactly
+ * what remove_clues_creek() would have found, and the first accepted
+ * removal invalidates the speculation behind it, which is discarded
+ * and retried against the new clue set. So the generated puzzle is
+ * the same as the single-threaded one for a given random seed.
+ */
+static int creek_gen_threads = 1;
+
+struct creek_genworker {
+    struct creek_genpool *pool;
+    pthread_t thread;
+    signed char *clues, *soln;
+    struct solver_scratch_creek *scc;
+};
+
+struct creek_genpool {
+    int w, h, diff, nthreads;
+    struct creek_genworker *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    const signed char *clues;    /* committed clue set for this batch */
+    const int *cand;
+    int ncand, next, pending;
+    bool *removable;
+    bool quit;
+};
+
+static void *genworker_creek(void *ctx)
+{
+    struct creek_genworker *wk = (struct creek_genworker *)ctx;
+    struct creek_genpool *pool = wk->pool;
+    int w = pool->w, h = pool->h, W = w+1, H = h+1;
+    int k;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->quit && pool->next >= pool->ncand)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if (pool->quit)
+            break;
+        k = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+
+        memcpy(wk->clues, pool->clues, W*H);
+        wk->clues[pool->cand[k]] = -1;
+        initialize_solver_creek(w, h, wk->clues, wk->soln, wk->scc, pool->diff);
+        pool->removable[k] = (creek_solve(w, h, wk->clues, wk->soln,
+                                          wk->scc, pool->diff) == 1);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static struct creek_genpool *new_genpool_creek(int w, int h, int diff,
+                                               int nthreads)
+{
+    struct creek_genpool *pool = snew(struct creek_genpool);
+    int i;
+
+    pool->w = w;
+    pool->h = h;
+    pool->diff = diff;
+    pool->nthreads = nthreads;
+    pool->ncand = pool->next = pool->pending = 0;
+    pool->removable = snewn(nthreads, bool);
+    pool->quit = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->workers = snewn(nthreads, struct creek_genworker);
+    for (i = 0; i < nthreads; i++) {
+        struct creek_genworker *wk = &pool->workers[i];
+        wk->pool = pool;
+        wk->clues = snewn((w+1)*(h+1), signed char);
+        wk->soln = snewn(w*h, signed char);
+        wk->scc = new_scratch_creek(w, h);
+        pthread_create(&wk->thread, NULL, genworker_creek, wk);
+    }
+    return pool;
+}
+
+static void free_genpool_creek(struct creek_genpool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nthreads; i++) {
+        struct creek_genworker *wk = &pool->workers[i];
+        pthread_join(wk->thread, NULL);
+        free_scratch_creek(wk->scc);
+        sfree(wk->soln);
+        sfree(wk->clues);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    sfree(pool->workers);
+    sfree(pool->removable);
+    sfree(pool);
+}
+
+static void remove_clues_parallel_creek(struct creek_genpool *pool,
+                                        signed char *clues,
+                                        const int *cand, int ncand)
+{
+    int pos = 0, n, k;
+
+    while (pos < ncand) {
+        n = min(pool->nthreads, ncand - pos);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->clues = clues;
+        pool->cand = cand + pos;
+        pool->next = 0;
+        pool->ncand = pool->pending = n;
+        pthread_cond_broadcast(&pool->work);
+        while (pool->pending > 0)
+            pthread_cond_wait(&pool->done, &pool->lock);
+        pool->ncand = 0;
+        pthread_mutex_unlock(&pool->lock);
+
+        for (k = 0; k < n; k++)
+            if (pool->removable[k])
+                break;
+        if (k < n) {
+            clues[cand[pos+k]] = -1;
+            pos += k+1;
+        } else {
+            pos += n;
+        }
+    }
+}
+#endif
+
 static char *new_game_desc(const game_params *params, random_state *rs,
                            char **aux, bool interactive)
 {
     int w = params->w, h = params->h, W = w+1, H = h+1;
     signed char *soln, *tmpsoln, *clues;
-    int *clueindices;
+    int *clueindices, *cand, ncand;
     struct solver_scratch_creek *scc;
+#ifdef USE_PTHREADS
+    struct creek_genpool *pool;
+#endif
     int x, y, v, i, j;
     char *desc;
     char cont;
@@ -770,7 +1591,12 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     tmpsoln = snewn(w*h, signed char);
     clues = snewn(W*H, signed char);
     clueindices = snewn(W*H, int);
+    cand = snewn(W*H, int);
     scc = new_scratch_creek(w, h);
+#ifdef USE_PTHREADS
+    pool = (creek_gen_threads > 1 ?
+            new_genpool_creek(w, h, params->diff, creek_gen_threads) : NULL);
+#endif
 
     do {
         /*
@@ -815,6 +1641,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
             clueindices[i] = i;
         shuffle(clueindices, W*H, sizeof(*clueindices), rs);
         for (j = 0; j < 2; j++) {
+            ncand = 0;
             for (i = 0; i < W*H; i++) {
                 int pass;
                 bool yb, xb;
@@ -838,13 +1665,16 @@ static char *new_game_desc(const game_params *params, random_state *rs,
                 else
                     pass = 1;
 
-                if (pass == j) {
-                    clues[y*W+x] = -1;
-                    initialize_solver_creek(w, h, clues, tmpsoln, scc, params->diff);
-                    if (creek_solve(w, h, clues, tmpsoln, scc, params->diff) != 1)
-                        clues[y*W+x] = v;           /* put it back */
-                }
+                if (pass == j)
+                    cand[ncand++] = clueindices[i];
             }
+#ifdef USE_PTHREADS
+            if (pool)
+                remove_clues_parallel_creek(pool, clues, cand, ncand);
+            else
+#endif
+                remove_clues_creek(w, h, params->diff, clues, cand, ncand,
+                                   tmpsoln, scc);
         }
         /*
          * And finally, verify that the grid is of _at least_ the
@@ -895,7 +1725,12 @@ static char *new_game_desc(const game_params *params, random_state *rs,
         desc = sresize(desc, p - desc, char);
     }
 
+#ifdef USE_PTHREADS
+    if (pool)
+        free_genpool_creek(pool);
+#endif
     free_scratch_creek(scc);
+    sfree(cand);
     sfree(clueindices);
     sfree(clues);
     sfree(tmpsoln);
@@ -1662,3 +2497,264 @@ const struct game thegame = {
     REQUIRE_RBUTTON,                                 /* flags */
 };
 
+#ifdef STANDALONE_SOLVER
+
+#include <time.h>
+
+/*
+ * Wall-clock seconds, so that threaded runs are timed fairly. Without
+ * a monotonic clock this falls back to processor time, which adds up
+ * across threads.
+ */
+static double timer_creek(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static char *generate_batch_creek(const game_params *p, const char *seed,
+                                  int count, double *secs)
+{
+    random_state *rs = random_new(seed, strlen(seed));
+    char *descs = NULL, *desc;
+    size_t len = 0, dlen;
+    double start = timer_creek();
+    int i;
+
+    for (i = 0; i < count; i++) {
+        desc = new_game_desc(p, rs, NULL, false);
+        dlen = strlen(desc);
+        descs = sresize(descs, len + dlen + 2, char);
+        memcpy(descs + len, desc, dlen);
+        len += dlen;
+        descs[len++] = '\n';
+        descs[len] = '\0';
+        sfree(desc);
+    }
+    *secs = timer_creek() - start;
+    random_free(rs);
+    return descs;
+}
+
+/*
+ * Differential test of the bitboard clue pass against the scalar one:
+ * solve each generated puzzle, plus randomly thinned and corrupted
+ * versions of it, at every difficulty with both, and compare.
+ */
+static int check_cores_creek(const game_params *p, const char *seed,
+                             int count)
+{
+    int w = p->w, h = p->h, W = w+1, H = h+1;
+    random_state *rs = random_new(seed, strlen(seed));
+    struct solver_scratch_creek *scc = new_scratch_creek(w, h);
+    signed char *clues = snewn(W*H, signed char);
+    signed char *ref = snewn(w*h, signed char);
+    signed char *soln = snewn(w*h, signed char);
+    int i, t, k, diff, ret, rret, nsolves = 0, nbad = 0;
+
+    for (i = 0; i < count; i++) {
+        char *desc = new_game_desc(p, rs, NULL, false);
+        game_state *state = new_game(NULL, p, desc);
+
+        for (t = 0; t < 8; t++) {
+            memcpy(clues, state->clues->clues, W*H);
+            for (k = 0; k < W*H; k++) {
+                if (t >= 2 && random_upto(rs, 4) == 0)
+                    clues[k] = -1;
+                if (t >= 5 && random_upto(rs, 8) == 0)
+                    clues[k] = random_upto(rs, 5);
+            }
+            if (t == 1) {
+                /* The full clue set of the solution. */
+                initialize_solver_creek(w, h, clues, ref, scc, DIFF_HARD);
+                creek_solve(w, h, clues, ref, scc, DIFF_HARD);
+                for (k = 0; k < W*H; k++)
+                    clues[k] = vertex_degree_creek(w, h, ref, k % W, k / W,
+                                                   false, NULL, NULL);
+            }
+
+            for (diff = 0; diff < DIFFCOUNT; diff++) {
+                solver_scalar_clues = true;
+                initialize_solver_creek(w, h, clues, ref, scc, diff);
+                rret = creek_solve(w, h, clues, ref, scc, diff);
+                solver_scalar_clues = false;
+                initialize_solver_creek(w, h, clues, soln, scc, diff);
+                ret = creek_solve(w, h, clues, soln, scc, diff);
+                nsolves++;
+                if (ret != rret || (ret != 0 && memcmp(ref, soln, w*h))) {
+                    char *pstr = encode_params(p, false);
+                    printf("mismatch: %s:%s trial %d diff %d: "
+                           "scalar %d, bitboard %d\n",
+                           pstr, desc, t, diff, rret, ret);
+                    sfree(pstr);
+                    nbad++;
+                }
+            }
+        }
+        free_game(state);
+        sfree(desc);
+    }
+
+    printf("%d solves compared, %d mismatches\n", nsolves, nbad);
+    sfree(soln);
+    sfree(ref);
+    sfree(clues);
+    free_scratch_creek(scc);
+    random_free(rs);
+    return nbad;
+}
+
+int main(int argc, char **argv)
+{
+    game_params *p;
+    char *id = NULL, *desc, *descs;
+    const char *seed = "creek", *err;
+    bool bench = false, check = false;
+    int count = 1, threads = 1;
+    double secs;
+    const char *progname = argv[0];
+
+    while (--argc > 0) {
+        char *arg = *++argv;
+        if (!strcmp(arg, "--bench")) {
+            bench = true;
+        } else if (!strcmp(arg, "--check")) {
+            check = true;
+        } else if (!strcmp(arg, "--full-rebuild")) {
+            solver_full_rebuild = true;
+        } else if (!strcmp(arg, "--scalar")) {
+            solver_scalar_clues = true;
+        } else if (!strcmp(arg, "-n") && argc > 1) {
+            count = atoi(*++argv);
+            argc--;
+        } else if (!strcmp(arg, "-j") && argc > 1) {
+            threads = atoi(*++argv);
+            argc--;
+        } else if (!strcmp(arg, "--seed") && argc > 1) {
+            seed = *++argv;
+            argc--;
+        } else if (*arg == '-') {
+            fprintf(stderr, "%s: unrecognised option `%s'\n", progname, arg);
+            return 1;
+        } else {
+            id = arg;
+        }
+    }
+
+    if (!id) {
+        fprintf(stderr, "usage: %s [--bench | --check | --full-rebuild | "
+                "--scalar] [-n count] [-j threads] [--seed seed] "
+                "<params> | <game_id>\n", progname);
+        return 1;
+    }
+
+#ifdef USE_PTHREADS
+    creek_gen_threads = max(threads, 1);
+#else
+    if (threads > 1)
+        fprintf(stderr, "%s: built without thread support, "
+                "ignoring -j\n", progname);
+#endif
+
+    p = default_params();
+    desc = strchr(id, ':');
+    if (desc)
+        *desc++ = '\0';
+    decode_params(p, id);
+
+    /* Sizes above the game's limit are accepted here for benchmarking. */
+    if (p->w < 3 || p->h < 3) {
+        fprintf(stderr, "%s: width and height must both be at least three\n",
+                progname);
+        return 1;
+    }
+
+    if (desc) {
+        game_state *s;
+        const char *error = NULL;
+        char *move, *text;
+
+        err = validate_desc(p, desc);
+        if (err) {
+            fprintf(stderr, "%s: %s\n", progname, err);
+            return 1;
+        }
+        s = new_game(NULL, p, desc);
+        move = solve_game(s, s, NULL, &error);
+        if (!move) {
+            printf("%s\n", error);
+        } else {
+            game_state *t = execute_move(s, move);
+            text = game_text_format(t);
+            fputs(text, stdout);
+            sfree(text);
+            free_game(t);
+            sfree(move);
+        }
+        free_game(s);
+    } else if (check) {
+        if (check_cores_creek(p, seed, count))
+            return 1;
+    } else if (bench) {
+        char *ref;
+        double refsecs;
+        bool mismatch = false;
+
+        id = encode_params(p, true);
+        printf("%s: %d puzzles\n", id, count);
+        sfree(id);
+
+#ifdef USE_PTHREADS
+        creek_gen_threads = 1;
+#endif
+        ref = generate_batch_creek(p, seed, count, &refsecs);
+        printf("  default solver:      %8.3fs\n", refsecs);
+
+        solver_full_rebuild = true;
+        descs = generate_batch_creek(p, seed, count, &secs);
+        solver_full_rebuild = false;
+        printf("  full dsf rebuild:    %8.3fs  (%.2fx)\n", secs,
+               refsecs > 0 ? secs / refsecs : 0.0);
+        mismatch |= strcmp(descs, ref) != 0;
+        sfree(descs);
+
+        solver_scalar_clues = true;
+        descs = generate_batch_creek(p, seed, count, &secs);
+        solver_scalar_clues = false;
+        printf("  scalar clue pass:    %8.3fs  (%.2fx)\n", secs,
+               refsecs > 0 ? secs / refsecs : 0.0);
+        mismatch |= strcmp(descs, ref) != 0;
+        sfree(descs);
+
+#ifdef USE_PTHREADS
+        if (threads > 1) {
+            creek_gen_threads = threads;
+            descs = generate_batch_creek(p, seed, count, &secs);
+            printf("  %2d threads:          %8.3fs  (%.2fx)\n", threads, secs,
+                   refsecs > 0 ? secs / refsecs : 0.0);
+            mismatch |= strcmp(descs, ref) != 0;
+            sfree(descs);
+        }
+#endif
+        sfree(ref);
+
+        if (mismatch) {
+            printf("  MISMATCH: generated puzzles differ\n");
+            return 1;
+        }
+    } else {
+        descs = generate_batch_creek(p, seed, count, &secs);
+        fputs(descs, stdout);
+        sfree(descs);
+    }
+
+    free_params(p);
+    return 0;
+}
+
+#endif
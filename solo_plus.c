@@ -88,9 +88,16 @@
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#include <limits.h>
+
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
 
 #ifdef STANDALONE_SOLVER
 #include <stdarg.h>
+#include <errno.h>
+#include <time.h>
 int solver_show_working, solver_recurse_depth;
 #endif
 
@@ -107,6 +114,14 @@ int solver_show_working, solver_recurse_depth;
 typedef unsigned char digit;
 #define ORDER_MAX 255
 
+/*
+ * Digits are shown and typed as 1-9, then a-z, then A-Z, which gives
+ * a single character to each digit of any order up to 61. That must
+ * also stay within CANDSET_BITS, since both the solver and gridgen
+ * keep each set of digits in one 64-bit candset word.
+ */
+#define SYMBOLS_MAX 61
+
 #define PREFERRED_TILE_SIZE 48
 #define TILE_SIZE (ds->tilesize)
 #define BORDER (TILE_SIZE / 2)
@@ -139,67 +154,79 @@ enum {
 };
 
 /*
- * To determine all possible ways to reach a given sum by adding two or
- * three numbers from 1..9, each of which occurs exactly once in the sum,
- * these arrays contain a list of bitmasks for each sum value, where if
- * bit N is set, it means that N occurs in the sum.  Each list is
- * terminated by a zero if it is shorter than the size of the array.
+ * Killer cage sums. ksum_sets lists every set of distinct digits
+ * from 1..KSUM_ORDER_MAX as a bitmask, with bit n-1 set if digit n
+ * is in the set (the same convention as the solver's candidates).
+ * The sets are grouped by size and total: those of k digits adding
+ * up to s are group g = KSUM_GROUP(k,s), which runs from
+ * ksum_sets[ksum_start[g]] up to ksum_sets[ksum_start[g+1]]. Within
+ * each group the masks are in increasing order, so for a puzzle of
+ * order cr the sets that only use digits up to cr are a prefix of
+ * the group.
+ *
+ * ksum_digits[cr][k][s] is the union of that prefix: the digits
+ * which can appear at all in a cage of k squares adding up to s.
+ * Equivalently, digit n passes exactly when the other k-1 squares
+ * can make up s-n from distinct digits other than n, which is the
+ * tightest possible minimum/maximum sum check on a cage.
+ *
+ * The tables are built once, the first time a killer puzzle is set
+ * up, and never change after that.
+ *
+ * precompute_sum_bits() builds them without any locking, so it must
+ * not be called on more than one thread at once. new_game_desc() and
+ * new_game() call it before any generator workers start, and the
+ * standalone batch solver only calls new_game() under its lock, so
+ * the solver itself can read the tables freely from any thread.
  */
-#define MAX_2SUMS 5
-#define MAX_3SUMS 8
-#define MAX_4SUMS 12
-static unsigned long sum_bits2[18][MAX_2SUMS];
-static unsigned long sum_bits3[25][MAX_3SUMS];
-static unsigned long sum_bits4[31][MAX_4SUMS];
+#define KSUM_ORDER_MAX 16
+#define KSUM_MAX (KSUM_ORDER_MAX * (KSUM_ORDER_MAX + 1) / 2)
+#define KSUM_GROUP(k,s) ((k) * (KSUM_MAX + 1) + (s))
+static unsigned short ksum_sets[1 << KSUM_ORDER_MAX];
+static int ksum_start[(KSUM_ORDER_MAX + 1) * (KSUM_MAX + 1) + 1];
+static unsigned short ksum_digits[KSUM_ORDER_MAX + 1][KSUM_ORDER_MAX + 1]
+                                [KSUM_MAX + 1];
+static bool ksum_built = false;
 
-static int find_sum_bits(unsigned long *array, int idx, int value_left,
-                         int addends_left, int min_addend,
-                         unsigned long bitmask_so_far)
+static void precompute_sum_bits(void)
 {
-    int i;
-    assert(addends_left >= 2);
+    int mask, n, k, sum, top;
+    size_t i;
 
-    for (i = min_addend; i < value_left; i++) {
-        unsigned long new_bitmask = bitmask_so_far | (1L << i);
-        assert(bitmask_so_far != new_bitmask);
+    if (ksum_built)
+        return;
 
-        if (addends_left == 2) {
-            int j = value_left - i;
-            if (j <= i)
-                break;
-            if (j > 9)
-                continue;
-            array[idx++] = new_bitmask | (1L << j);
-        } else
-            idx = find_sum_bits(array, idx, value_left - i,
-                                addends_left - 1, i + 1,
-                                new_bitmask);
+    /*
+     * Counting sort of all the sets by (size, total), visiting the
+     * masks in increasing order so that each group comes out
+     * sorted too.
+     */
+    memset(ksum_start, 0, sizeof(ksum_start));
+    for (mask = 0; mask < (1 << KSUM_ORDER_MAX); mask++) {
+        for (k = sum = 0, n = 1; n <= KSUM_ORDER_MAX; n++)
+            if (mask & (1 << (n-1)))
+                k++, sum += n;
+        ksum_start[KSUM_GROUP(k, sum) + 1]++;
     }
-    return idx;
-}
-
-static void precompute_sum_bits(void)
-{
-    int i;
-    for (i = 3; i < 31; i++) {
-        int j;
-        if (i < 18) {
-            j = find_sum_bits(sum_bits2[i], 0, i, 2, 1, 0);
-            assert (j <= MAX_2SUMS);
-            if (j < MAX_2SUMS)
-                sum_bits2[i][j] = 0;
-        }
-        if (i < 25) {
-            j = find_sum_bits(sum_bits3[i], 0, i, 3, 1, 0);
-            assert (j <= MAX_3SUMS);
-            if (j < MAX_3SUMS)
-                sum_bits3[i][j] = 0;
-        }
-        j = find_sum_bits(sum_bits4[i], 0, i, 4, 1, 0);
-        assert (j <= MAX_4SUMS);
-        if (j < MAX_4SUMS)
-            sum_bits4[i][j] = 0;
+    for (i = 1; i < lenof(ksum_start); i++)
+        ksum_start[i] += ksum_start[i-1];
+
+    memset(ksum_digits, 0, sizeof(ksum_digits));
+    for (mask = 0; mask < (1 << KSUM_ORDER_MAX); mask++) {
+        for (k = sum = top = 0, n = 1; n <= KSUM_ORDER_MAX; n++)
+            if (mask & (1 << (n-1)))
+                k++, sum += n, top = n;
+        /* ksum_start[] steps one group forward as each is filled */
+        ksum_sets[ksum_start[KSUM_GROUP(k, sum)]++] = mask;
+        for (n = max(top, 1); n <= KSUM_ORDER_MAX; n++)
+            ksum_digits[n][k][sum] |= mask;
     }
+    /* ... so shift it back again */
+    for (i = lenof(ksum_start) - 1; i > 0; i--)
+        ksum_start[i] = ksum_start[i-1];
+    ksum_start[0] = 0;
+
+    ksum_built = true;
 }
 
 struct game_params {
@@ -527,10 +554,12 @@ static const char *validate_params(const game_params *params, bool full)
         return "Both dimensions must be at least 2";
     if (params->c > ORDER_MAX || params->r > ORDER_MAX)
         return "Dimensions greater than "STR(ORDER_MAX)" are not supported";
-    if ((params->c * params->r) > 31)
-        return "Unable to support more than 31 distinct symbols in a puzzle";
-    if (params->killer && params->c * params->r > 9)
-        return "Killer puzzle dimensions must be smaller than 10";
+    if ((params->c * params->r) > SYMBOLS_MAX)
+        return "Unable to support more than "STR(SYMBOLS_MAX)
+            " distinct symbols in a puzzle";
+    if (params->killer && params->c * params->r > KSUM_ORDER_MAX)
+        return "Killer puzzle dimensions greater than "STR(KSUM_ORDER_MAX)
+            " are not supported";
     if (params->xtype && params->c * params->r < 4)
         return "X-type puzzle dimensions must be larger than 3";
     return NULL;
@@ -610,6 +639,33 @@ static struct block_structure *dup_block_structure(struct block_structure *b)
     return nb;
 }
 
+/*
+ * Make an existing block structure over the same area into a copy of
+ * another, reusing its storage when the block counts match.
+ */
+static void copy_block_structure(struct block_structure *nb,
+                                 struct block_structure *b)
+{
+    int i;
+
+    assert(nb->area == b->area);
+    if (nb->nr_blocks != b->nr_blocks ||
+        nb->max_nr_squares != b->max_nr_squares) {
+        nb->nr_blocks = b->nr_blocks;
+        nb->max_nr_squares = b->max_nr_squares;
+        nb->blocks_data = sresize(nb->blocks_data,
+                                  b->nr_blocks * b->max_nr_squares, int);
+        nb->nr_squares = sresize(nb->nr_squares, b->nr_blocks, int);
+        nb->blocks = sresize(nb->blocks, b->nr_blocks, int *);
+        for (i = 0; i < nb->nr_blocks; i++)
+            nb->blocks[i] = nb->blocks_data + i*nb->max_nr_squares;
+    }
+    memcpy(nb->nr_squares, b->nr_squares, b->nr_blocks * sizeof *b->nr_squares);
+    memcpy(nb->whichblock, b->whichblock, b->area * sizeof *b->whichblock);
+    memcpy(nb->blocks_data, b->blocks_data,
+           b->nr_blocks * b->max_nr_squares * sizeof *b->blocks_data);
+}
+
 static void split_block(struct block_structure *b, int *squares, int nr_squares)
 {
     int i, j;
@@ -723,18 +779,71 @@ static void remove_from_block(struct block_structure *blocks, int b, int n)
  *    get any further.
  */
 
+/*
+ * The solver's candidate cube is kept as bitsets, like gridgen's.
+ * Each square has a word in which bit n-1 is set if digit n could
+ * still go there, and each house (row, column, block or diagonal)
+ * has a word per digit in which bit i is set if that digit could
+ * still go in the house's ith square. A 64-bit word covers every
+ * order we can be asked to solve.
+ */
+typedef unsigned long long candset;
+#define CANDSET_BITS 64
+#define CANDBIT(i) ((candset)1 << (i))
+#define CANDALL(cr) ((cr) >= CANDSET_BITS ? ~(candset)0 : CANDBIT(cr) - 1)
+#if SYMBOLS_MAX > CANDSET_BITS
+#error "SYMBOLS_MAX must fit in a candset"
+#endif
+
+static int cand_count(candset s)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(s);
+#else
+    int n = 0;
+    for (; s; s &= s-1)
+        n++;
+    return n;
+#endif
+}
+
+/* Index of the lowest set bit; s must be non-zero. */
+static int cand_first(candset s)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(s);
+#else
+    int i = 0;
+    assert(s);
+    while (!(s & 1))
+        s >>= 1, i++;
+    return i;
+#endif
+}
+
 struct solver_usage {
     int cr;
     struct block_structure *blocks, *kblocks, *extra_cages;
+    bool xtype;
     /*
-     * We set up a cubic array, indexed by x, y and digit; each
-     * element of this array is true or false according to whether
-     * or not that digit _could_ in principle go in that position.
-     *
-     * The way to index this array is cube[(y*cr+x)*cr+n-1]; there
-     * are macros below to help with this.
+     * cand[y*cr+x] has bit n-1 set if digit n could in principle
+     * go in that square. There are macros below which read it in
+     * the style of a cubic array of booleans, indexed by x, y and
+     * digit; all removals go through solver_rule_out(), which also
+     * keeps `where' up to date.
+     */
+    candset *cand;
+    /*
+     * Houses are numbered rows first (0..cr-1), then columns, then
+     * blocks, then for X-type puzzles the two diagonals; see the
+     * HOUSE_* macros. house[h*cr+i] is the index of the ith square
+     * in house h, and where[h*cr+n-1] has bit i set if digit n
+     * could go in that square. blkpos gives each square's position
+     * within its block.
      */
-    bool *cube;
+    int nr_houses;
+    int *house, *blkpos;
+    candset *where;
     /*
      * This is the grid in which we write down our final
      * deductions. y-coordinates in here are _not_ transformed.
@@ -748,31 +857,104 @@ struct solver_usage {
     /*
      * Now we keep track, at a slightly higher level, of what we
      * have yet to work out, to prevent doing the same deduction
-     * many times.
+     * many times. placed[h] has bit n-1 set if digit n has been
+     * placed in house h.
      */
-    /* row[y*cr+n-1] true if digit n has been placed in row y */
-    bool *row;
-    /* col[x*cr+n-1] true if digit n has been placed in row x */
-    bool *col;
-    /* blk[i*cr+n-1] true if digit n has been placed in block i */
-    bool *blk;
-    /* diag[i*cr+n-1] true if digit n has been placed in diagonal i */
-    bool *diag;                        /* diag 0 is \, 1 is / */
+    candset *placed;
 
     int *regions;
     int nr_regions;
     int **sq2region;
+
+    /*
+     * When recursion is allowed, every change made to cand and grid
+     * is recorded on an undo trail, so that a wrong guess can be
+     * rolled back rather than the whole structure being rebuilt
+     * for every guess. A non-negative entry is a cube position
+     * that was ruled out; ~xy is a placement in square xy. The
+     * first complete grid the search reaches is copied to
+     * solution.
+     */
+    int *trail;
+    int ntrail;
+    digit *solution;
+    bool solved;
+    /*
+     * The trail doesn't cover the killer cages, which are reshaped
+     * as squares are filled in and deduced cages split off them.
+     * Each guess starts again from the cages as given.
+     */
+    struct block_structure *kblocks_orig;
+    digit *kclues_orig;
 };
 #define cubepos2(xy,n) ((xy)*usage->cr+(n)-1)
 #define cubepos(x,y,n) cubepos2((y)*usage->cr+(x),n)
-#define cube(x,y,n) (usage->cube[cubepos(x,y,n)])
-#define cube2(xy,n) (usage->cube[cubepos2(xy,n)])
+#define cube2(xy,n) ((usage->cand[xy] >> ((n)-1)) & 1)
+#define cube(x,y,n) cube2((y)*usage->cr+(x),n)
+#define cubeat(pos) cube2((pos)/usage->cr, (pos)%usage->cr+1)
+
+#define HOUSE_ROW(y) (y)
+#define HOUSE_COL(x) (usage->cr+(x))
+#define HOUSE_BLK(b) (2*usage->cr+(b))
+#define HOUSE_DIAG(d) (3*usage->cr+(d))
+#define where(h,n) (usage->where[(h)*usage->cr+(n)-1])
+#define housesq(h) (usage->house + (h)*usage->cr)
+#define placed_in(h,n) ((usage->placed[h] >> ((n)-1)) & 1)
 
 #define ondiag0(xy) ((xy) % (cr+1) == 0)
 #define ondiag1(xy) ((xy) % (cr-1) == 0 && (xy) > 0 && (xy) < cr*cr-1)
 #define diag0(i) ((i) * (cr+1))
 #define diag1(i) ((i+1) * (cr-1))
 
+/*
+ * Remove digit n from the candidates for square xy, in both halves
+ * of the bitset representation. (Both diagonals visit their
+ * squares in increasing y, so y is also the diagonal position.)
+ */
+static void solver_rule_out(struct solver_usage *usage, int xy, int n)
+{
+    int cr = usage->cr;
+    int x = xy % cr, y = xy / cr;
+
+    if (!(usage->cand[xy] & CANDBIT(n-1)))
+        return;
+    if (usage->trail)
+        usage->trail[usage->ntrail++] = cubepos2(xy, n);
+
+    usage->cand[xy] &= ~CANDBIT(n-1);
+    where(HOUSE_ROW(y), n) &= ~CANDBIT(x);
+    where(HOUSE_COL(x), n) &= ~CANDBIT(y);
+    where(HOUSE_BLK(usage->blocks->whichblock[xy]), n) &=
+        ~CANDBIT(usage->blkpos[xy]);
+    if (usage->xtype) {
+        if (ondiag0(xy))
+            where(HOUSE_DIAG(0), n) &= ~CANDBIT(y);
+        if (ondiag1(xy))
+            where(HOUSE_DIAG(1), n) &= ~CANDBIT(y);
+    }
+}
+
+/*
+ * Return the position of square xy within house h, or -1 if it
+ * isn't in that house at all.
+ */
+static int solver_house_pos(struct solver_usage *usage, int h, int xy)
+{
+    int cr = usage->cr;
+    int x = xy % cr, y = xy / cr;
+
+    if (h < HOUSE_COL(0))
+        return y == h ? x : -1;
+    if (h < HOUSE_BLK(0))
+        return x == h - HOUSE_COL(0) ? y : -1;
+    if (h < HOUSE_DIAG(0))
+        return usage->blocks->whichblock[xy] == h - HOUSE_BLK(0) ?
+            usage->blkpos[xy] : -1;
+    if (h == HOUSE_DIAG(0))
+        return ondiag0(xy) ? y : -1;
+    return ondiag1(xy) ? y : -1;
+}
+
 /*
  * Function called when we are certain that a particular square has
  * a particular number in it. The y-coordinate passed in here is
@@ -782,65 +964,84 @@ static void solver_place(struct solver_usage *usage, int x, int y, int n)
 {
     int cr = usage->cr;
     int sqindex = y*cr+x;
-    int i, bi;
+    int houses[5], nhouses, i;
+    candset bits;
 
     assert(cube(x,y,n));
 
     /*
      * Rule out all other numbers in this square.
      */
-    for (i = 1; i <= cr; i++)
-        if (i != n)
-            cube(x,y,i) = false;
-
-    /*
-     * Rule out this number in all other positions in the row.
-     */
-    for (i = 0; i < cr; i++)
-        if (i != y)
-            cube(x,i,n) = false;
-
-    /*
-     * Rule out this number in all other positions in the column.
-     */
-    for (i = 0; i < cr; i++)
-        if (i != x)
-            cube(i,y,n) = false;
+    for (bits = usage->cand[sqindex] & ~CANDBIT(n-1); bits; bits &= bits-1)
+        solver_rule_out(usage, sqindex, cand_first(bits) + 1);
 
     /*
-     * Rule out this number in all other positions in the block.
+     * Rule out this number in all other positions in the row, the
+     * column, the block and any diagonal the square is on, and
+     * cross it out from the list of numbers left to place in each.
      */
-    bi = usage->blocks->whichblock[sqindex];
-    for (i = 0; i < cr; i++) {
-        int bp = usage->blocks->blocks[bi][i];
-        if (bp != sqindex)
-            cube2(bp,n) = false;
+    nhouses = 0;
+    houses[nhouses++] = HOUSE_ROW(y);
+    houses[nhouses++] = HOUSE_COL(x);
+    houses[nhouses++] = HOUSE_BLK(usage->blocks->whichblock[sqindex]);
+    if (usage->xtype && ondiag0(sqindex))
+        houses[nhouses++] = HOUSE_DIAG(0);
+    if (usage->xtype && ondiag1(sqindex))
+        houses[nhouses++] = HOUSE_DIAG(1);
+    for (i = 0; i < nhouses; i++) {
+        for (bits = where(houses[i], n); bits; bits &= bits-1) {
+            int sq = housesq(houses[i])[cand_first(bits)];
+            if (sq != sqindex)
+                solver_rule_out(usage, sq, n);
+        }
+        usage->placed[houses[i]] |= CANDBIT(n-1);
     }
 
     /*
      * Enter the number in the result grid.
      */
+    if (usage->trail && !usage->grid[sqindex])
+        usage->trail[usage->ntrail++] = ~sqindex;
     usage->grid[sqindex] = n;
+}
 
-    /*
-     * Cross out this number from the list of numbers left to place
-     * in its row, its column and its block.
-     */
-    usage->row[y*cr+n-1] = usage->col[x*cr+n-1] =
-        usage->blk[bi*cr+n-1] = true;
+/*
+ * Roll back every change recorded on the trail since it was `mark'
+ * entries long.
+ */
+static void solver_undo(struct solver_usage *usage, int mark)
+{
+    int cr = usage->cr;
 
-    if (usage->diag) {
-        if (ondiag0(sqindex)) {
-            for (i = 0; i < cr; i++)
-                if (diag0(i) != sqindex)
-                    cube2(diag0(i),n) = false;
-            usage->diag[n-1] = true;
-        }
-        if (ondiag1(sqindex)) {
-            for (i = 0; i < cr; i++)
-                if (diag1(i) != sqindex)
-                    cube2(diag1(i),n) = false;
-            usage->diag[cr+n-1] = true;
+    while (usage->ntrail > mark) {
+        int t = usage->trail[--usage->ntrail];
+
+        if (t < 0) {
+            int xy = ~t, x = xy % cr, y = xy / cr;
+            candset bit = CANDBIT(usage->grid[xy]-1);
+
+            usage->placed[HOUSE_ROW(y)] &= ~bit;
+            usage->placed[HOUSE_COL(x)] &= ~bit;
+            usage->placed[HOUSE_BLK(usage->blocks->whichblock[xy])] &= ~bit;
+            if (usage->xtype && ondiag0(xy))
+                usage->placed[HOUSE_DIAG(0)] &= ~bit;
+            if (usage->xtype && ondiag1(xy))
+                usage->placed[HOUSE_DIAG(1)] &= ~bit;
+            usage->grid[xy] = 0;
+        } else {
+            int xy = t / cr, n = t % cr + 1, x = xy % cr, y = xy / cr;
+
+            usage->cand[xy] |= CANDBIT(n-1);
+            where(HOUSE_ROW(y), n) |= CANDBIT(x);
+            where(HOUSE_COL(x), n) |= CANDBIT(y);
+            where(HOUSE_BLK(usage->blocks->whichblock[xy]), n) |=
+                CANDBIT(usage->blkpos[xy]);
+            if (usage->xtype) {
+                if (ondiag0(xy))
+                    where(HOUSE_DIAG(0), n) |= CANDBIT(y);
+                if (ondiag1(xy))
+                    where(HOUSE_DIAG(1), n) |= CANDBIT(y);
+            }
         }
     }
 }
@@ -852,47 +1053,46 @@ static void solver_place(struct solver_usage *usage, int x, int y, int n)
  * gets debugged.
  */
 struct solver_scratch;
-static int solver_elim(struct solver_usage *usage, int *indices,
+static int solver_elim(struct solver_usage *usage, candset set,
+                       const int *squares, int sq, int n,
                        const char *fmt, ...)
-    __attribute__((format(printf,3,4)));
+    __attribute__((format(printf,6,7)));
 static int solver_intersect(struct solver_usage *usage,
-                            int *indices1, int *indices2, const char *fmt, ...)
-    __attribute__((format(printf,4,5)));
+                            int h1, int h2, int n, const char *fmt, ...)
+    __attribute__((format(printf,5,6)));
 static int solver_set(struct solver_usage *usage,
                       struct solver_scratch *scratch,
                       int *indices, const char *fmt, ...)
     __attribute__((format(printf,4,5)));
 #endif
 
-static int solver_elim(struct solver_usage *usage, int *indices
+/*
+ * Elimination: `set' is a bitset of the cr ways in which some
+ * requirement could be met, of which exactly one must happen.
+ * Either squares lists a house, bit i of set stands for digit n
+ * going in squares[i], and we're doing positional elimination; or
+ * squares is NULL, bit i stands for digit i+1 going in square sq,
+ * and we're doing numeric elimination.
+ */
+static int solver_elim(struct solver_usage *usage, candset set,
+                       const int *squares, int sq, int n
 #ifdef STANDALONE_SOLVER
                        , const char *fmt, ...
 #endif
                        )
 {
     int cr = usage->cr;
-    int fpos, m, i;
-
-    /*
-     * Count the number of set bits within this section of the
-     * cube.
-     */
-    m = 0;
-    fpos = -1;
-    for (i = 0; i < cr; i++)
-        if (usage->cube[indices[i]]) {
-            fpos = indices[i];
-            m++;
-        }
+    int m = cand_count(set);
 
     if (m == 1) {
-        int x, y, n;
-        assert(fpos >= 0);
+        int x, y;
 
-        n = 1 + fpos % cr;
-        x = fpos / cr;
-        y = x / cr;
-        x %= cr;
+        if (squares)
+            sq = squares[cand_first(set)];
+        else
+            n = cand_first(set) + 1;
+        x = sq % cr;
+        y = sq / cr;
 
         if (!usage->grid[y*cr+x]) {
 #ifdef STANDALONE_SOLVER
@@ -927,83 +1127,88 @@ static int solver_elim(struct solver_usage *usage, int *indices
     return 0;
 }
 
+/*
+ * Intersectional analysis: if every possible position for digit n
+ * in house h1 also lies in house h2, then n can't go anywhere else
+ * in h2.
+ */
 static int solver_intersect(struct solver_usage *usage,
-                            int *indices1, int *indices2
+                            int h1, int h2, int n
 #ifdef STANDALONE_SOLVER
                             , const char *fmt, ...
 #endif
                             )
 {
-    int cr = usage->cr;
-    int ret, i, j;
+    candset bits, inside;
 
     /*
-     * Loop over the first domain and see if there's any set bit
-     * not also in the second.
+     * Translate the positions of n in the first house into
+     * positions in the second, giving up if any of them aren't in
+     * the second house at all.
      */
-    for (i = j = 0; i < cr; i++) {
-        int p = indices1[i];
-        while (j < cr && indices2[j] < p)
-            j++;
-        if (usage->cube[p]) {
-            if (j < cr && indices2[j] == p)
-                continue;               /* both domains contain this index */
-            else
-                return 0;               /* there is, so we can't deduce */
-        }
+    inside = 0;
+    for (bits = where(h1, n); bits; bits &= bits-1) {
+        int pos = solver_house_pos(usage, h2,
+                                   housesq(h1)[cand_first(bits)]);
+        if (pos < 0)
+            return 0;
+        inside |= CANDBIT(pos);
     }
 
     /*
-     * We have determined that all set bits in the first domain are
-     * within its overlap with the second. So loop over the second
-     * domain and remove all set bits that aren't also in that
-     * overlap; return +1 iff we actually _did_ anything.
+     * Now everything else in the second house can go; return +1
+     * iff there actually was anything.
      */
-    ret = 0;
-    for (i = j = 0; i < cr; i++) {
-        int p = indices2[i];
-        while (j < cr && indices1[j] < p)
-            j++;
-        if (usage->cube[p] && (j >= cr || indices1[j] != p)) {
-#ifdef STANDALONE_SOLVER
-            if (solver_show_working) {
-                int px, py, pn;
-
-                if (!ret) {
-                    va_list ap;
-                    printf("%*s", solver_recurse_depth*4, "");
-                    va_start(ap, fmt);
-                    vprintf(fmt, ap);
-                    va_end(ap);
-                    printf(":\n");
-                }
-
-                pn = 1 + p % cr;
-                px = p / cr;
-                py = px / cr;
-                px %= cr;
+    bits = where(h2, n) & ~inside;
+    if (!bits)
+        return 0;
 
-                printf("%*s  ruling out %d at (%d,%d)\n",
-                       solver_recurse_depth*4, "", pn, 1+px, 1+py);
-            }
+#ifdef STANDALONE_SOLVER
+    if (solver_show_working) {
+        va_list ap;
+        printf("%*s", solver_recurse_depth*4, "");
+        va_start(ap, fmt);
+        vprintf(fmt, ap);
+        va_end(ap);
+        printf(":\n");
+    }
 #endif
-            ret = +1;                       /* we did something */
-            usage->cube[p] = false;
-        }
+    for (; bits; bits &= bits-1) {
+        int p = housesq(h2)[cand_first(bits)];
+#ifdef STANDALONE_SOLVER
+        if (solver_show_working)
+            printf("%*s  ruling out %d at (%d,%d)\n",
+                   solver_recurse_depth*4, "", n,
+                   1 + p % usage->cr, 1 + p / usage->cr);
+#endif
+        solver_rule_out(usage, p, n);
     }
 
-    return ret;
+    return +1;
 }
 
 struct solver_scratch {
-    unsigned char *grid, *rowidx, *colidx, *set;
+    unsigned char *grid, *rowidx, *colidx;
+    candset *setrows, *setcols, *setunion;
+    int *setpick;
     int *neighbours, *bfsqueue;
-    int *indexlist, *indexlist2;
+    int *indexlist;
 #ifdef STANDALONE_SOLVER
     int *bfsprev;
 #endif
 };
 
+/*
+ * The largest subset solver_set() will look for, or 0 for no limit
+ * beyond the natural one. Lowering it trades missed deductions for
+ * speed, so it's only adjustable in the standalone solver.
+ */
+#ifdef STANDALONE_SOLVER
+static int solver_set_max = 0;
+#else
+#define solver_set_max 0
+#endif
+
 static int solver_set(struct solver_usage *usage,
                       struct solver_scratch *scratch,
                       int *indices
@@ -1013,11 +1218,12 @@ static int solver_set(struct solver_usage *usage,
                       )
 {
     int cr = usage->cr;
-    int i, j, n, count;
-    unsigned char *grid = scratch->grid;
+    int i, j, n, pass, depth, next, limit;
     unsigned char *rowidx = scratch->rowidx;
     unsigned char *colidx = scratch->colidx;
-    unsigned char *set = scratch->set;
+    candset *rows = scratch->setrows, *cols = scratch->setcols;
+    candset *uni = scratch->setunion;
+    int *pick = scratch->setpick;
 
     /*
      * We are passed a cr-by-cr matrix of booleans. Our first job
@@ -1030,7 +1236,7 @@ static int solver_set(struct solver_usage *usage,
     for (i = 0; i < cr; i++) {
         int count = 0, first = -1;
         for (j = 0; j < cr; j++)
-            if (usage->cube[indices[i*cr+j]])
+            if (cubeat(indices[i*cr+j]))
                 first = j, count++;
 
         /*
@@ -1070,54 +1276,69 @@ static int solver_set(struct solver_usage *usage,
     assert(n == j);
 
     /*
-     * And create the smaller matrix.
+     * And create the smaller matrix, as bitsets both ways round:
+     * bit j of rows[i] and bit i of cols[j] are set if entry (i,j)
+     * is.
      */
+    for (i = 0; i < n; i++)
+        rows[i] = cols[i] = 0;
     for (i = 0; i < n; i++)
         for (j = 0; j < n; j++)
-            grid[i*cr+j] = usage->cube[indices[rowidx[i]*cr+colidx[j]]];
+            if (cubeat(indices[rowidx[i]*cr+colidx[j]])) {
+                rows[i] |= CANDBIT(j);
+                cols[j] |= CANDBIT(i);
+            }
 
     /*
-     * Having done that, we now have a matrix in which every row
-     * has at least two 1s in. Now we search to see if we can find
-     * a rectangle of zeroes (in the set-theoretic sense of
-     * `rectangle', i.e. a subset of rows crossed with a subset of
-     * columns) whose width and height add up to n.
+     * Every row of the matrix now has at least two 1s in. A
+     * useful subset has at least two members and leaves at least
+     * two rows outside it, so a matrix this small has nothing for
+     * us.
      */
+    if (n < 4)
+        return 0;
 
-    memset(set, 0, n);
-    count = 0;
-    while (1) {
-        /*
-         * We have a candidate set. If its size is <=1 or >=n-1
-         * then we move on immediately.
-         */
-        if (count > 1 && count < n-1) {
-            /*
-             * The number of rows we need is n-count. See if we can
-             * find that many rows which each have a zero in all
-             * the positions listed in `set'.
-             */
-            int rows = 0;
-            for (i = 0; i < n; i++) {
-                bool ok = true;
-                for (j = 0; j < n; j++)
-                    if (set[j] && grid[i*cr+j]) {
-                        ok = false;
-                        break;
-                    }
-                if (ok)
-                    rows++;
+    /*
+     * Now we search for k columns whose 1s all lie within the same
+     * k rows (those rows must then use up those columns, so their
+     * other 1s can go), or for k rows whose 1s all lie within the
+     * same k columns (so no other row can use those columns). Both
+     * come to the same thing - k columns confined to k rows leave
+     * the other n-k rows confined to the other n-k columns - so we
+     * need only try subsets of up to n/2 on each side to find
+     * every deduction.
+     *
+     * Subsets are built up in increasing order of index, keeping
+     * the union of their entries as we go, and we abandon a branch
+     * as soon as that union is too big for any subset we'd try to
+     * fit it in. If a union ever has fewer members than its
+     * subset, the puzzle is internally inconsistent.
+     */
+    limit = n / 2;
+    if (solver_set_max > 0 && limit > solver_set_max)
+        limit = solver_set_max;
+
+    for (pass = 0; pass < 2; pass++) {
+        candset *m = (pass == 0 ? cols : rows);
+
+        depth = next = 0;
+        uni[0] = 0;
+        while (1) {
+            int count;
+
+            if (depth == limit || next == n) {
+                if (depth == 0)
+                    break;
+                next = pick[--depth] + 1;
+                continue;
             }
 
-            /*
-             * We expect never to be able to get _more_ than
-             * n-count suitable rows: this would imply that (for
-             * example) there are four numbers which between them
-             * have at most three possible positions, and hence it
-             * indicates a faulty deduction before this point or
-             * even a bogus clue.
-             */
-            if (rows > n - count) {
+            pick[depth] = next++;
+            uni[depth+1] = uni[depth] | m[pick[depth]];
+            depth++;
+            count = cand_count(uni[depth]);
+
+            if (depth >= 2 && count < depth) {
 #ifdef STANDALONE_SOLVER
                 if (solver_show_working) {
                     va_list ap;
@@ -1133,78 +1354,77 @@ static int solver_set(struct solver_usage *usage,
                 return -1;
             }
 
-            if (rows >= n - count) {
+            if (depth >= 2 && count == depth) {
+                candset sel = 0;
                 bool progress = false;
 
+                for (j = 0; j < depth; j++)
+                    sel |= CANDBIT(pick[j]);
+
                 /*
-                 * We've got one! Now, for each row which _doesn't_
-                 * satisfy the criterion, eliminate all its set
-                 * bits in the positions _not_ listed in `set'.
-                 * Return +1 (meaning progress has been made) if we
-                 * successfully eliminated anything at all.
+                 * We've got one! Find the 1s it rules out: for k
+                 * columns, the other 1s in their k rows; for k
+                 * rows, the 1s in their k columns belonging to any
+                 * other row. Return +1 (meaning progress has been
+                 * made) if there were any at all.
                  * 
                  * This involves referring back through
                  * rowidx/colidx in order to work out which actual
                  * positions in the cube to meddle with.
                  */
                 for (i = 0; i < n; i++) {
-                    bool ok = true;
-                    for (j = 0; j < n; j++)
-                        if (set[j] && grid[i*cr+j]) {
-                            ok = false;
-                            break;
-                        }
-                    if (!ok) {
-                        for (j = 0; j < n; j++)
-                            if (!set[j] && grid[i*cr+j]) {
-                                int fpos = indices[rowidx[i]*cr+colidx[j]];
+                    candset elim;
+
+                    if (pass == 0)
+                        elim = (uni[depth] & CANDBIT(i)) ? rows[i] & ~sel : 0;
+                    else
+                        elim = (sel & CANDBIT(i)) ? 0 : rows[i] & uni[depth];
+
+                    for (; elim; elim &= elim-1) {
+                        int fpos;
+
+                        j = cand_first(elim);
+                        fpos = indices[rowidx[i]*cr+colidx[j]];
 #ifdef STANDALONE_SOLVER
-                                if (solver_show_working) {
-                                    int px, py, pn;
-
-                                    if (!progress) {
-                                        va_list ap;
-                                        printf("%*s", solver_recurse_depth*4,
-                                               "");
-                                        va_start(ap, fmt);
-                                        vprintf(fmt, ap);
-                                        va_end(ap);
-                                        printf(":\n");
-                                    }
+                        if (solver_show_working) {
+                            int px, py, pn;
+
+                            if (!progress) {
+                                va_list ap;
+                                printf("%*s", solver_recurse_depth*4,
+                                       "");
+                                va_start(ap, fmt);
+                                vprintf(fmt, ap);
+                                va_end(ap);
+                                printf(":\n");
+                            }
 
-                                    pn = 1 + fpos % cr;
-                                    px = fpos / cr;
-                                    py = px / cr;
-                                    px %= cr;
+                            pn = 1 + fpos % cr;
+                            px = fpos / cr;
+                            py = px / cr;
+                            px %= cr;
 
-                                    printf("%*s  ruling out %d at (%d,%d)\n",
-                                           solver_recurse_depth*4, "",
-                                           pn, 1+px, 1+py);
-                                }
+                            printf("%*s  ruling out %d at (%d,%d)\n",
+                                   solver_recurse_depth*4, "",
+                                   pn, 1+px, 1+py);
+                        }
 #endif
-                                progress = true;
-                                usage->cube[fpos] = false;
-                            }
+                        progress = true;
+                        solver_rule_out(usage, fpos / cr, 1 + fpos % cr);
                     }
                 }
 
-                if (progress) {
+                if (progress)
                     return +1;
-                }
             }
-        }
 
-        /*
-         * Binary increment: change the rightmost 0 to a 1, and
-         * change all 1s to the right of it to 0s.
-         */
-        i = n;
-        while (i > 0 && set[i-1])
-            set[--i] = 0, count--;
-        if (i > 0)
-            set[--i] = 1, count++;
-        else
-            break;                     /* done */
+            /*
+             * No subset we're prepared to try can contain this
+             * one, so move on to its next sibling.
+             */
+            if (count > limit)
+                next = pick[--depth] + 1;
+        }
     }
 
     return 0;
@@ -1260,22 +1480,20 @@ static int solver_forcing(struct solver_usage *usage,
 
     for (y = 0; y < cr; y++)
         for (x = 0; x < cr; x++) {
-            int count, t, n;
+            candset bits = usage->cand[y*cr+x];
+            int t, n;
 
             /*
              * If this square doesn't have exactly two candidate
              * numbers, don't try it.
              * 
-             * In this loop we also sum the candidate numbers,
-             * which is a nasty hack to allow us to quickly find
-             * `the other one' (since we will shortly know there
-             * are exactly two).
+             * We also sum the two candidate numbers, which is a
+             * nasty hack to allow us to quickly find `the other
+             * one'.
              */
-            for (count = t = 0, n = 1; n <= cr; n++)
-                if (cube(x, y, n))
-                    count++, t += n;
-            if (count != 2)
+            if (cand_count(bits) != 2)
                 continue;
+            t = cand_first(bits) + cand_first(bits & (bits-1)) + 2;
 
             /*
              * Now attempt a bfs for each candidate.
@@ -1317,7 +1535,7 @@ static int solver_forcing(struct solver_usage *usage,
                         xt = usage->blocks->whichblock[yy*cr+xx];
                         for (yt = 0; yt < cr; yt++)
                             neighbours[nneighbours++] = usage->blocks->blocks[xt][yt];
-                        if (usage->diag) {
+                        if (usage->xtype) {
                             int sqindex = yy*cr+xx;
                             if (ondiag0(sqindex)) {
                                 for (i = 0; i < cr; i++)
@@ -1333,7 +1551,7 @@ static int solver_forcing(struct solver_usage *usage,
                          * Try visiting each of those neighbours.
                          */
                         for (i = 0; i < nneighbours; i++) {
-                            int cc, tt, nn;
+                            candset nbits;
 
                             xt = neighbours[i] % cr;
                             yt = neighbours[i] / cr;
@@ -1360,15 +1578,14 @@ static int solver_forcing(struct solver_usage *usage,
                              * this square to have exactly two
                              * possible numbers.
                              */
-                            for (cc = tt = 0, nn = 1; nn <= cr; nn++)
-                                if (cube(xt, yt, nn))
-                                    cc++, tt += nn;
-                            if (cc == 2) {
+                            nbits = usage->cand[yt*cr+xt];
+                            if (cand_count(nbits) == 2) {
                                 bfsqueue[tail++] = yt*cr+xt;
 #ifdef STANDALONE_SOLVER
                                 bfsprev[yt*cr+xt] = yy*cr+xx;
 #endif
-                                number[yt*cr+xt] = tt - currn;
+                                number[yt*cr+xt] = cand_first(nbits) +
+                                    cand_first(nbits & (nbits-1)) + 2 - currn;
                             }
 
                             /*
@@ -1381,7 +1598,7 @@ static int solver_forcing(struct solver_usage *usage,
                             if (currn == orign &&
                                 (xt == x || yt == y ||
                                  (usage->blocks->whichblock[yt*cr+xt] == usage->blocks->whichblock[y*cr+x]) ||
-                                 (usage->diag && ((ondiag0(yt*cr+xt) && ondiag0(y*cr+x)) ||
+                                 (usage->xtype && ((ondiag0(yt*cr+xt) && ondiag0(y*cr+x)) ||
                                                   (ondiag1(yt*cr+xt) && ondiag1(y*cr+x)))))) {
 #ifdef STANDALONE_SOLVER
                                 if (solver_show_working) {
@@ -1406,7 +1623,7 @@ static int solver_forcing(struct solver_usage *usage,
                                            orign, 1+xt, 1+yt);
                                 }
 #endif
-                                cube(xt, yt, orign) = false;
+                                solver_rule_out(usage, yt*cr+xt, orign);
                                 return 1;
                             }
                         }
@@ -1429,15 +1646,36 @@ static int solver_killer_minmax(struct solver_usage *usage,
     int i;
     int ret = 0;
     int nsquares = cages->nr_squares[b];
+    candset allowed;
 
     if (clues[b] == 0)
         return 0;
 
+    /*
+     * The digits that can go anywhere in a cage of this size and
+     * total come straight out of the sum tables. Beyond that, look
+     * at the candidates actually left in the other squares.
+     */
+    allowed = CANDALL(cr);
+    if (cr <= KSUM_ORDER_MAX && nsquares <= cr)
+        allowed = clues[b] <= KSUM_MAX ?
+            ksum_digits[cr][nsquares][clues[b]] : 0;
+
     for (i = 0; i < nsquares; i++) {
         int n, x = cages->blocks[b][i];
 
         for (n = 1; n <= cr; n++)
-            if (cube2(x, n)) {
+            if (cube2(x, n) && !(allowed & CANDBIT(n-1))) {
+                solver_rule_out(usage, x, n);
+                ret = 1;
+#ifdef STANDALONE_SOLVER
+                if (solver_show_working)
+                    printf("%*s  ruling out %d at (%d,%d) as no %d-sum of"
+                           " %d uses it %s\n",
+                           solver_recurse_depth*4, "killer minmax analysis",
+                           n, 1 + x%cr, 1 + x/cr, nsquares, clues[b], extra);
+#endif
+            } else if (cube2(x, n)) {
                 int maxval = 0, minval = 0;
                 int j;
                 for (j = 0; j < nsquares; j++) {
@@ -1457,7 +1695,7 @@ static int solver_killer_minmax(struct solver_usage *usage,
                         }
                 }
                 if (maxval + n < clues[b]) {
-                    cube2(x, n) = false;
+                    solver_rule_out(usage, x, n);
                     ret = 1;
 #ifdef STANDALONE_SOLVER
                     if (solver_show_working)
@@ -1467,7 +1705,7 @@ static int solver_killer_minmax(struct solver_usage *usage,
 #endif
                 }
                 if (minval + n > clues[b]) {
-                    cube2(x, n) = false;
+                    solver_rule_out(usage, x, n);
                     ret = 1;
 #ifdef STANDALONE_SOLVER
                     if (solver_show_working)
@@ -1490,13 +1728,23 @@ static int solver_killer_sums(struct solver_usage *usage, int b,
                               )
 {
     int cr = usage->cr;
-    int i, ret, max_sums;
+    int i, ret, start, end;
     int nsquares = cages->nr_squares[b];
-    unsigned long *sumbits, possible_addends;
+    candset possible_addends;
 
     if (clue == 0) {
-        assert(nsquares == 0);
-        return 0;
+        /*
+         * Squares left over with nothing to add up to can only come
+         * from a wrong guess further up the recursion.
+         */
+        if (nsquares == 0)
+            return 0;
+#ifdef STANDALONE_SOLVER
+        if (solver_show_working)
+            printf("%*skiller: cage sum used up with squares left\n",
+                   solver_recurse_depth*4, "");
+#endif
+        return -1;
     }
     if (nsquares == 0) {
 #ifdef STANDALONE_SOLVER
@@ -1507,7 +1755,7 @@ static int solver_killer_sums(struct solver_usage *usage, int b,
         return -1;
     }
 
-    if (nsquares < 2 || nsquares > 4)
+    if (nsquares < 2 || nsquares > cr || cr > KSUM_ORDER_MAX)
         return 0;
 
     if (!cage_is_region) {
@@ -1537,50 +1785,29 @@ static int solver_killer_sums(struct solver_usage *usage, int b,
         if (known_block == -1 && known_col == -1 && known_row == -1)
             return 0;
     }
-    if (nsquares == 2) {
-        if (clue < 3 || clue > 17)
-            return -1;
-
-        sumbits = sum_bits2[clue];
-        max_sums = MAX_2SUMS;
-    } else if (nsquares == 3) {
-        if (clue < 6 || clue > 24)
-            return -1;
-
-        sumbits = sum_bits3[clue];
-        max_sums = MAX_3SUMS;
-    } else {
-        if (clue < 10 || clue > 30)
-            return -1;
+    if (clue > KSUM_MAX)
+        return -1;
+    start = ksum_start[KSUM_GROUP(nsquares, clue)];
+    end = ksum_start[KSUM_GROUP(nsquares, clue) + 1];
 
-        sumbits = sum_bits4[clue];
-        max_sums = MAX_4SUMS;
-    }
     /*
      * For every possible way to get the sum, see if there is
      * one square in the cage that disallows all the required
      * addends.  If we find one such square, this way to compute
-     * the sum is impossible.
+     * the sum is impossible. Sets using digits beyond cr come at
+     * the end of the group, so we can stop at the first of them.
      */
     possible_addends = 0;
-    for (i = 0; i < max_sums; i++) {
+    for (i = start; i < end; i++) {
         int j;
-        unsigned long bits = sumbits[i];
+        candset bits = ksum_sets[i];
 
-        if (bits == 0)
+        if (bits > CANDALL(cr))
             break;
 
-        for (j = 0; j < nsquares; j++) {
-            int n;
-            unsigned long square_bits = bits;
-            int x = cages->blocks[b][j];
-            for (n = 1; n <= cr; n++)
-                if (!cube2(x, n))
-                    square_bits &= ~(1L << n);
-            if (square_bits == 0) {
+        for (j = 0; j < nsquares; j++)
+            if (!(bits & usage->cand[cages->blocks[b][j]]))
                 break;
-            }
-        }
         if (j == nsquares)
             possible_addends |= bits;
     }
@@ -1599,8 +1826,8 @@ static int solver_killer_sums(struct solver_usage *usage, int b,
         for (n = 1; n <= cr; n++) {
             if (!cube2(x, n))
                 continue;
-            if ((possible_addends & (1 << n)) == 0) {
-                cube2(x, n) = false;
+            if (!(possible_addends & CANDBIT(n-1))) {
+                solver_rule_out(usage, x, n);
                 ret = 1;
 #ifdef STANDALONE_SOLVER
                 if (solver_show_working) {
@@ -1681,14 +1908,16 @@ static struct solver_scratch *solver_new_scratch(struct solver_usage *usage)
     scratch->grid = snewn(cr*cr, unsigned char);
     scratch->rowidx = snewn(cr, unsigned char);
     scratch->colidx = snewn(cr, unsigned char);
-    scratch->set = snewn(cr, unsigned char);
+    scratch->setrows = snewn(cr, candset);
+    scratch->setcols = snewn(cr, candset);
+    scratch->setunion = snewn(cr+1, candset);
+    scratch->setpick = snewn(cr, int);
     scratch->neighbours = snewn(5*cr, int);
     scratch->bfsqueue = snewn(cr*cr, int);
 #ifdef STANDALONE_SOLVER
     scratch->bfsprev = snewn(cr*cr, int);
 #endif
     scratch->indexlist = snewn(cr*cr, int);   /* used for set elimination */
-    scratch->indexlist2 = snewn(cr, int);   /* only used for intersect() */
     return scratch;
 }
 
@@ -1699,12 +1928,14 @@ static void solver_free_scratch(struct solver_scratch *scratch)
 #endif
     sfree(scratch->bfsqueue);
     sfree(scratch->neighbours);
-    sfree(scratch->set);
+    sfree(scratch->setrows);
+    sfree(scratch->setcols);
+    sfree(scratch->setunion);
+    sfree(scratch->setpick);
     sfree(scratch->colidx);
     sfree(scratch->rowidx);
     sfree(scratch->grid);
     sfree(scratch->indexlist);
-    sfree(scratch->indexlist2);
     sfree(scratch);
 }
 
@@ -1719,74 +1950,56 @@ struct difficulty {
     int diff, kdiff;
 };
 
-static void solver(int cr, struct block_structure *blocks,
-                  struct block_structure *kblocks, bool xtype,
-                  digit *grid, digit *kgrid, struct difficulty *dlev)
-{
-    struct solver_usage *usage;
-    struct solver_scratch *scratch;
-    int x, y, b, i, n, ret;
-    int diff = DIFF_BLOCK;
-    int kdiff = DIFF_KSINGLE;
+static void solver_search(struct solver_usage *usage,
+                          struct solver_scratch *scratch,
+                          struct difficulty *dlev);
 
+/*
+ * A solver context holds everything the solver needs that depends
+ * only on the grid layout: the house and region tables, the scratch
+ * space, and the working copies of the killer cages. Callers which
+ * solve many grids on the same blocks, like the generator, make one
+ * with solver_ctx_new() and pass it to solver_ctx_solve() each time,
+ * which only has to reset the candidate state. solver() is the
+ * one-off version.
+ */
+struct solver_ctx {
+    struct solver_usage usage;
+    struct solver_scratch *scratch;
     /*
-     * Set up a usage structure as a clean slate (everything
-     * possible).
+     * Allocated the first time a solve needs them. kblocks is the
+     * working copy of the killer cages, which the solver reshapes;
+     * usage.kblocks points at it only while solving a killer grid.
      */
-    usage = snew(struct solver_usage);
-    usage->cr = cr;
-    usage->blocks = blocks;
-    if (kblocks) {
-        usage->kblocks = dup_block_structure(kblocks);
-        usage->extra_cages = alloc_block_structure (kblocks->c, kblocks->r,
-                                                    cr * cr, cr, cr * cr);
-        usage->extra_clues = snewn(cr*cr, digit);
-    } else {
-        usage->kblocks = usage->extra_cages = NULL;
-        usage->extra_clues = NULL;
-    }
-    usage->cube = snewn(cr*cr*cr, bool);
-    usage->grid = grid;                       /* write straight back to the input */
-    if (kgrid) {
-        int nclues;
-
-        assert(kblocks);
-        nclues = kblocks->nr_blocks;
-        /*
-         * Allow for expansion of the killer regions, the absolute
-         * limit is obviously one region per square.
-         */
-        usage->kclues = snewn(cr*cr, digit);
-        for (i = 0; i < nclues; i++) {
-            for (n = 0; n < kblocks->nr_squares[i]; n++)
-                if (kgrid[kblocks->blocks[i][n]] != 0)
-                    usage->kclues[i] = kgrid[kblocks->blocks[i][n]];
-            assert(usage->kclues[i] > 0);
-        }
-        memset(usage->kclues + nclues, 0, cr*cr - nclues);
-    } else {
-        usage->kclues = NULL;
-    }
-
-    for (i = 0; i < cr*cr*cr; i++)
-        usage->cube[i] = true;
+    struct block_structure *kblocks, *extra_cages;
+    digit *kclues, *extra_clues, *kclues_orig, *solution;
+    int *trail;
+};
 
-    usage->row = snewn(cr * cr, bool);
-    usage->col = snewn(cr * cr, bool);
-    usage->blk = snewn(cr * cr, bool);
-    memset(usage->row, 0, cr * cr * sizeof(bool));
-    memset(usage->col, 0, cr * cr * sizeof(bool));
-    memset(usage->blk, 0, cr * cr * sizeof(bool));
+/*
+ * (Re)build the house and region tables for a block layout. The
+ * generator calls this whenever it lays out new jigsaw blocks.
+ */
+static void solver_ctx_set_blocks(struct solver_ctx *ctx,
+                                  struct block_structure *blocks)
+{
+    struct solver_usage *usage = &ctx->usage;
+    int cr = usage->cr;
+    int x, y, b, i, n;
 
-    if (xtype) {
-        usage->diag = snewn(cr * 2, bool);
-        memset(usage->diag, 0, cr * 2 * sizeof(bool));
-    } else
-        usage->diag = NULL; 
-
-    usage->nr_regions = cr * 3 + (xtype ? 2 : 0);
-    usage->regions = snewn(cr * usage->nr_regions, int);
-    usage->sq2region = snewn(cr * cr * 3, int *);
+    usage->blocks = blocks;
+    for (n = 0; n < cr; n++)
+        for (i = 0; i < cr; i++) {
+            housesq(HOUSE_ROW(n))[i] = n*cr+i;
+            housesq(HOUSE_COL(n))[i] = i*cr+n;
+            housesq(HOUSE_BLK(n))[i] = usage->blocks->blocks[n][i];
+            usage->blkpos[usage->blocks->blocks[n][i]] = i;
+        }
+    if (usage->xtype)
+        for (i = 0; i < cr; i++) {
+            housesq(HOUSE_DIAG(0))[i] = diag0(i);
+            housesq(HOUSE_DIAG(1))[i] = diag1(i);
+        }
 
     for (n = 0; n < cr; n++) {
         for (i = 0; i < cr; i++) {
@@ -1801,24 +2014,214 @@ static void solver(int cr, struct block_structure *blocks,
             usage->sq2region[b*3 + 2] = usage->regions + cr*n*3 + 2*cr;
         }
     }
+}
+
+static struct solver_ctx *solver_ctx_new(int cr,
+                                         struct block_structure *blocks,
+                                         bool xtype)
+{
+    struct solver_ctx *ctx = snew(struct solver_ctx);
+    struct solver_usage *usage = &ctx->usage;
+
+    assert(cr <= CANDSET_BITS);
+    usage->cr = cr;
+    usage->xtype = xtype;
+    usage->kblocks = usage->extra_cages = NULL;
+    usage->kclues = usage->extra_clues = NULL;
+
+    usage->nr_houses = cr * 3 + (xtype ? 2 : 0);
+    usage->cand = snewn(cr * cr, candset);
+    usage->where = snewn(cr * usage->nr_houses, candset);
+    usage->placed = snewn(usage->nr_houses, candset);
+    usage->house = snewn(cr * usage->nr_houses, int);
+    usage->blkpos = snewn(cr * cr, int);
+
+    usage->nr_regions = cr * 3 + (xtype ? 2 : 0);
+    usage->regions = snewn(cr * usage->nr_regions, int);
+    usage->sq2region = snewn(cr * cr * 3, int *);
+
+    solver_ctx_set_blocks(ctx, blocks);
+    ctx->scratch = solver_new_scratch(usage);
+
+    ctx->kblocks = ctx->extra_cages = NULL;
+    ctx->kclues = ctx->extra_clues = ctx->kclues_orig = NULL;
+    ctx->solution = NULL;
+    ctx->trail = NULL;
+
+    return ctx;
+}
+
+static void solver_ctx_free(struct solver_ctx *ctx)
+{
+    struct solver_usage *usage = &ctx->usage;
+
+    sfree(ctx->trail);
+    sfree(ctx->solution);
+    sfree(ctx->kclues_orig);
+    sfree(ctx->kclues);
+    sfree(ctx->extra_clues);
+    if (ctx->kblocks) {
+        free_block_structure(ctx->kblocks);
+        free_block_structure(ctx->extra_cages);
+    }
+    solver_free_scratch(ctx->scratch);
+    sfree(usage->sq2region);
+    sfree(usage->regions);
+    sfree(usage->cand);
+    sfree(usage->where);
+    sfree(usage->placed);
+    sfree(usage->house);
+    sfree(usage->blkpos);
+    sfree(ctx);
+}
+
+static void solver_ctx_solve(struct solver_ctx *ctx,
+                             struct block_structure *kblocks,
+                             digit *grid, digit *kgrid,
+                             struct difficulty *dlev)
+{
+    struct solver_usage *usage = &ctx->usage;
+    int cr = usage->cr;
+    int x, y, i, n;
+    bool ok = true;
+
+    /*
+     * Reset the usage structure to a clean slate (everything
+     * possible).
+     */
+    if (kblocks) {
+        if (!ctx->kblocks) {
+            ctx->kblocks = dup_block_structure(kblocks);
+            ctx->extra_cages = alloc_block_structure(kblocks->c, kblocks->r,
+                                                     cr * cr, cr, cr * cr);
+            ctx->extra_clues = snewn(cr*cr, digit);
+        } else
+            copy_block_structure(ctx->kblocks, kblocks);
+        usage->kblocks = ctx->kblocks;
+        usage->extra_cages = ctx->extra_cages;
+        usage->extra_clues = ctx->extra_clues;
+    } else {
+        usage->kblocks = usage->extra_cages = NULL;
+        usage->extra_clues = NULL;
+    }
+    usage->grid = grid;                       /* write straight back to the input */
+    if (kgrid) {
+        int nclues;
+
+        assert(kblocks);
+        nclues = kblocks->nr_blocks;
+        /*
+         * Allow for expansion of the killer regions, the absolute
+         * limit is obviously one region per square.
+         */
+        if (!ctx->kclues)
+            ctx->kclues = snewn(cr*cr, digit);
+        usage->kclues = ctx->kclues;
+        for (i = 0; i < nclues; i++) {
+            for (n = 0; n < kblocks->nr_squares[i]; n++)
+                if (kgrid[kblocks->blocks[i][n]] != 0)
+                    usage->kclues[i] = kgrid[kblocks->blocks[i][n]];
+            assert(usage->kclues[i] > 0);
+        }
+        memset(usage->kclues + nclues, 0, cr*cr - nclues);
+    } else {
+        usage->kclues = NULL;
+    }
 
-    scratch = solver_new_scratch(usage);
+    for (i = 0; i < cr*cr; i++)
+        usage->cand[i] = CANDALL(cr);
+    for (i = 0; i < cr * usage->nr_houses; i++)
+        usage->where[i] = CANDALL(cr);
+    for (i = 0; i < usage->nr_houses; i++)
+        usage->placed[i] = 0;
 
     /*
-     * Place all the clue numbers we are given.
+     * Place all the clue numbers we are given. These are never
+     * retracted, so they can go in before the trail is started.
      */
+    usage->trail = NULL;
+    usage->ntrail = 0;
+    usage->solution = NULL;
+    usage->solved = false;
+    usage->kblocks_orig = kblocks;
+    usage->kclues_orig = NULL;
     for (x = 0; x < cr; x++)
         for (y = 0; y < cr; y++) {
             int n = grid[y*cr+x];
             if (n) {
-                if (!cube(x,y,n)) {
-                    diff = DIFF_IMPOSSIBLE;
-                    goto got_result;
-                }
-                solver_place(usage, x, y, grid[y*cr+x]);
+                if (!cube(x,y,n))
+                    ok = false;
+                else
+                    solver_place(usage, x, y, grid[y*cr+x]);
             }
         }
 
+    if (!ok) {
+        dlev->diff = DIFF_IMPOSSIBLE;
+        dlev->kdiff = DIFF_KSINGLE;
+#ifdef STANDALONE_SOLVER
+        if (solver_show_working)
+            printf("%*sno solution found\n", solver_recurse_depth*4, "");
+#endif
+        return;
+    }
+
+    if (dlev->maxdiff >= DIFF_RECURSIVE) {
+        /*
+         * Every square/digit pair can be ruled out at most once
+         * and every square filled at most once along any one
+         * path through the search, which bounds the trail.
+         */
+        if (!ctx->trail) {
+            ctx->trail = snewn(cr*cr*(cr+1), int);
+            ctx->solution = snewn(cr*cr, digit);
+        }
+        usage->trail = ctx->trail;
+        usage->solution = ctx->solution;
+        if (usage->kclues) {
+            if (!ctx->kclues_orig)
+                ctx->kclues_orig = snewn(cr*cr, digit);
+            usage->kclues_orig = ctx->kclues_orig;
+            memcpy(usage->kclues_orig, usage->kclues, cr*cr);
+        }
+    }
+
+    solver_search(usage, ctx->scratch, dlev);
+
+    /*
+     * If we had to recurse, the grid has been rolled back to
+     * where the deductions ran out, so fetch the first
+     * solution the search found.
+     */
+    if (usage->solved && dlev->diff != DIFF_IMPOSSIBLE)
+        memcpy(grid, usage->solution, cr*cr);
+}
+
+static void solver(int cr, struct block_structure *blocks,
+                  struct block_structure *kblocks, bool xtype,
+                  digit *grid, digit *kgrid, struct difficulty *dlev)
+{
+    struct solver_ctx *ctx = solver_ctx_new(cr, blocks, xtype);
+
+    solver_ctx_solve(ctx, kblocks, grid, kgrid, dlev);
+    solver_ctx_free(ctx);
+}
+
+/*
+ * The main deduction loop, followed if necessary by recursion.
+ * Everything is done in place on usage; when this returns after
+ * recursing, the guesses have all been rolled back off the trail.
+ */
+static void solver_search(struct solver_usage *usage,
+                          struct solver_scratch *scratch,
+                          struct difficulty *dlev)
+{
+    int cr = usage->cr;
+    digit *grid = usage->grid;
+    int x, y, b, i, n, ret;
+    int diff = DIFF_BLOCK;
+    int kdiff = DIFF_KSINGLE;
+
     /*
      * Now loop over the grid repeatedly trying all permitted modes
      * of reasoning. The loop terminates if we complete an
@@ -1841,10 +2244,9 @@ static void solver(int cr, struct block_structure *blocks,
          */
         for (b = 0; b < cr; b++)
             for (n = 1; n <= cr; n++)
-                if (!usage->blk[b*cr+n-1]) {
-                    for (i = 0; i < cr; i++)
-                        scratch->indexlist[i] = cubepos2(usage->blocks->blocks[b][i],n);
-                    ret = solver_elim(usage, scratch->indexlist
+                if (!placed_in(HOUSE_BLK(b), n)) {
+                    ret = solver_elim(usage, where(HOUSE_BLK(b), n),
+                                      housesq(HOUSE_BLK(b)), -1, n
 #ifdef STANDALONE_SOLVER
                                       , "positional elimination,"
                                       " %d in block %s", n,
@@ -1884,10 +2286,16 @@ static void solver(int cr, struct block_structure *blocks,
                     usage->kclues[b] -= t;
                     /*
                      * Since cages are regions, this tells us something
-                     * about the other squares in the cage.
+                     * about the other squares in the cage. If one of
+                     * them has already been filled in with the same
+                     * digit, we've gone wrong somewhere.
                      */
                     for (n = 0; n < usage->kblocks->nr_squares[b]; n++) {
-                        cube2(usage->kblocks->blocks[b][n], t) = false;
+                        if (usage->grid[usage->kblocks->blocks[b][n]] == t) {
+                            diff = DIFF_IMPOSSIBLE;
+                            goto got_result;
+                        }
+                        solver_rule_out(usage, usage->kblocks->blocks[b][n], t);
                     }
                 }
 
@@ -1955,7 +2363,7 @@ static void solver(int cr, struct block_structure *blocks,
                         continue;
                     if (dlev->maxdiff >= DIFF_RECURSIVE) {
                         if (sum <= 0) {
-                            dlev->diff = DIFF_IMPOSSIBLE;
+                            diff = DIFF_IMPOSSIBLE;
                             goto got_result;
                         }
                     }
@@ -2102,10 +2510,9 @@ static void solver(int cr, struct block_structure *blocks,
          */
         for (y = 0; y < cr; y++)
             for (n = 1; n <= cr; n++)
-                if (!usage->row[y*cr+n-1]) {
-                    for (x = 0; x < cr; x++)
-                        scratch->indexlist[x] = cubepos(x, y, n);
-                    ret = solver_elim(usage, scratch->indexlist
+                if (!placed_in(HOUSE_ROW(y), n)) {
+                    ret = solver_elim(usage, where(HOUSE_ROW(y), n),
+                                      housesq(HOUSE_ROW(y)), -1, n
 #ifdef STANDALONE_SOLVER
                                       , "positional elimination,"
                                       " %d in row %d", n, 1+y
@@ -2124,10 +2531,9 @@ static void solver(int cr, struct block_structure *blocks,
          */
         for (x = 0; x < cr; x++)
             for (n = 1; n <= cr; n++)
-                if (!usage->col[x*cr+n-1]) {
-                    for (y = 0; y < cr; y++)
-                        scratch->indexlist[y] = cubepos(x, y, n);
-                    ret = solver_elim(usage, scratch->indexlist
+                if (!placed_in(HOUSE_COL(x), n)) {
+                    ret = solver_elim(usage, where(HOUSE_COL(x), n),
+                                      housesq(HOUSE_COL(x)), -1, n
 #ifdef STANDALONE_SOLVER
                                       , "positional elimination,"
                                       " %d in column %d", n, 1+x
@@ -2145,12 +2551,11 @@ static void solver(int cr, struct block_structure *blocks,
         /*
          * X-diagonal positional elimination.
          */
-        if (usage->diag) {
+        if (usage->xtype) {
             for (n = 1; n <= cr; n++)
-                if (!usage->diag[n-1]) {
-                    for (i = 0; i < cr; i++)
-                        scratch->indexlist[i] = cubepos2(diag0(i), n);
-                    ret = solver_elim(usage, scratch->indexlist
+                if (!placed_in(HOUSE_DIAG(0), n)) {
+                    ret = solver_elim(usage, where(HOUSE_DIAG(0), n),
+                                      housesq(HOUSE_DIAG(0)), -1, n
 #ifdef STANDALONE_SOLVER
                                       , "positional elimination,"
                                       " %d in \\-diagonal", n
@@ -2165,10 +2570,9 @@ static void solver(int cr, struct block_structure *blocks,
                     }
                 }
             for (n = 1; n <= cr; n++)
-                if (!usage->diag[cr+n-1]) {
-                    for (i = 0; i < cr; i++)
-                        scratch->indexlist[i] = cubepos2(diag1(i), n);
-                    ret = solver_elim(usage, scratch->indexlist
+                if (!placed_in(HOUSE_DIAG(1), n)) {
+                    ret = solver_elim(usage, where(HOUSE_DIAG(1), n),
+                                      housesq(HOUSE_DIAG(1)), -1, n
 #ifdef STANDALONE_SOLVER
                                       , "positional elimination,"
                                       " %d in /-diagonal", n
@@ -2190,9 +2594,8 @@ static void solver(int cr, struct block_structure *blocks,
         for (x = 0; x < cr; x++)
             for (y = 0; y < cr; y++)
                 if (!usage->grid[y*cr+x]) {
-                    for (n = 1; n <= cr; n++)
-                        scratch->indexlist[n-1] = cubepos(x, y, n);
-                    ret = solver_elim(usage, scratch->indexlist
+                    ret = solver_elim(usage, usage->cand[y*cr+x],
+                                      NULL, y*cr+x, 0
 #ifdef STANDALONE_SOLVER
                                       , "numeric elimination at (%d,%d)",
                                       1+x, 1+y
@@ -2216,26 +2619,20 @@ static void solver(int cr, struct block_structure *blocks,
         for (y = 0; y < cr; y++)
             for (b = 0; b < cr; b++)
                 for (n = 1; n <= cr; n++) {
-                    if (usage->row[y*cr+n-1] ||
-                        usage->blk[b*cr+n-1])
+                    if (placed_in(HOUSE_ROW(y), n) ||
+                        placed_in(HOUSE_BLK(b), n))
                         continue;
-                    for (i = 0; i < cr; i++) {
-                        scratch->indexlist[i] = cubepos(i, y, n);
-                        scratch->indexlist2[i] = cubepos2(usage->blocks->blocks[b][i], n);
-                    }
                     /*
                      * solver_intersect() never returns -1.
                      */
-                    if (solver_intersect(usage, scratch->indexlist,
-                                         scratch->indexlist2
+                    if (solver_intersect(usage, HOUSE_ROW(y), HOUSE_BLK(b), n
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in row %d vs block %s",
                                           n, 1+y, usage->blocks->blocknames[b]
 #endif
                                           ) ||
-                         solver_intersect(usage, scratch->indexlist2,
-                                         scratch->indexlist
+                         solver_intersect(usage, HOUSE_BLK(b), HOUSE_ROW(y), n
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in block %s vs row %d",
@@ -2253,23 +2650,17 @@ static void solver(int cr, struct block_structure *blocks,
         for (x = 0; x < cr; x++)
             for (b = 0; b < cr; b++)
                 for (n = 1; n <= cr; n++) {
-                    if (usage->col[x*cr+n-1] ||
-                        usage->blk[b*cr+n-1])
+                    if (placed_in(HOUSE_COL(x), n) ||
+                        placed_in(HOUSE_BLK(b), n))
                         continue;
-                    for (i = 0; i < cr; i++) {
-                        scratch->indexlist[i] = cubepos(x, i, n);
-                        scratch->indexlist2[i] = cubepos2(usage->blocks->blocks[b][i], n);
-                    }
-                    if (solver_intersect(usage, scratch->indexlist,
-                                         scratch->indexlist2
+                    if (solver_intersect(usage, HOUSE_COL(x), HOUSE_BLK(b), n
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in column %d vs block %s",
                                           n, 1+x, usage->blocks->blocknames[b]
 #endif
                                           ) ||
-                         solver_intersect(usage, scratch->indexlist2,
-                                         scratch->indexlist
+                         solver_intersect(usage, HOUSE_BLK(b), HOUSE_COL(x), n
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in block %s vs column %d",
@@ -2281,29 +2672,23 @@ static void solver(int cr, struct block_structure *blocks,
                     }
                 }
 
-        if (usage->diag) {
+        if (usage->xtype) {
             /*
              * Intersectional analysis, \-diagonal vs blocks.
              */
             for (b = 0; b < cr; b++)
                 for (n = 1; n <= cr; n++) {
-                    if (usage->diag[n-1] ||
-                        usage->blk[b*cr+n-1])
+                    if (placed_in(HOUSE_DIAG(0), n) ||
+                        placed_in(HOUSE_BLK(b), n))
                         continue;
-                    for (i = 0; i < cr; i++) {
-                        scratch->indexlist[i] = cubepos2(diag0(i), n);
-                        scratch->indexlist2[i] = cubepos2(usage->blocks->blocks[b][i], n);
-                    }
-                    if (solver_intersect(usage, scratch->indexlist,
-                                         scratch->indexlist2
+                    if (solver_intersect(usage, HOUSE_DIAG(0), HOUSE_BLK(b), n
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in \\-diagonal vs block %s",
                                           n, usage->blocks->blocknames[b]
 #endif
                                           ) ||
-                         solver_intersect(usage, scratch->indexlist2,
-                                         scratch->indexlist
+                         solver_intersect(usage, HOUSE_BLK(b), HOUSE_DIAG(0), n
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in block %s vs \\-diagonal",
@@ -2320,23 +2705,17 @@ static void solver(int cr, struct block_structure *blocks,
              */
             for (b = 0; b < cr; b++)
                 for (n = 1; n <= cr; n++) {
-                    if (usage->diag[cr+n-1] ||
-                        usage->blk[b*cr+n-1])
+                    if (placed_in(HOUSE_DIAG(1), n) ||
+                        placed_in(HOUSE_BLK(b), n))
                         continue;
-                    for (i = 0; i < cr; i++) {
-                        scratch->indexlist[i] = cubepos2(diag1(i), n);
-                        scratch->indexlist2[i] = cubepos2(usage->blocks->blocks[b][i], n);
-                    }
-                    if (solver_intersect(usage, scratch->indexlist,
-                                         scratch->indexlist2
+                    if (solver_intersect(usage, HOUSE_DIAG(1), HOUSE_BLK(b), n
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in /-diagonal vs block %s",
                                           n, usage->blocks->blocknames[b]
 #endif
                                           ) ||
-                         solver_intersect(usage, scratch->indexlist2,
-                                         scratch->indexlist
+                         solver_intersect(usage, HOUSE_BLK(b), HOUSE_DIAG(1), n
 #ifdef STANDALONE_SOLVER
                                           , "intersectional analysis,"
                                           " %d in block %s vs /-diagonal",
@@ -2416,7 +2795,7 @@ static void solver(int cr, struct block_structure *blocks,
             }
         }
 
-        if (usage->diag) {
+        if (usage->xtype) {
             /*
              * \-diagonal set elimination.
              */
@@ -2534,9 +2913,18 @@ static void solver(int cr, struct block_structure *blocks,
                     }
                 }
 
-        if (best != -1) {
-            int i, j;
-            digit *list, *ingrid, *outgrid;
+        if (best == -1) {
+            /*
+             * The grid is full. If this is the first solution the
+             * search has reached, keep it.
+             */
+            if (!usage->solved) {
+                memcpy(usage->solution, grid, cr*cr);
+                usage->solved = true;
+            }
+        } else {
+            int i, j, mark;
+            digit *list;
 
             diff = DIFF_IMPOSSIBLE;    /* no solution found yet */
 
@@ -2547,15 +2935,14 @@ static void solver(int cr, struct block_structure *blocks,
             x = best % cr;
 
             list = snewn(cr, digit);
-            ingrid = snewn(cr * cr, digit);
-            outgrid = snewn(cr * cr, digit);
-            memcpy(ingrid, grid, cr * cr);
 
             /* Make a list of the possible digits. */
             for (j = 0, n = 1; n <= cr; n++)
                 if (cube(x,y,n))
                     list[j++] = n;
 
+            mark = usage->ntrail;
+
 #ifdef STANDALONE_SOLVER
             if (solver_show_working) {
                 const char *sep = "";
@@ -2570,37 +2957,40 @@ static void solver(int cr, struct block_structure *blocks,
 #endif
 
             /*
-             * And step along the list, recursing back into the
-             * main solver at every stage.
+             * And step along the list, placing each digit in turn
+             * and going back round the main solver loop, then
+             * undoing everything that led to.
              */
             for (i = 0; i < j; i++) {
-                memcpy(outgrid, ingrid, cr * cr);
-                outgrid[y*cr+x] = list[i];
-
 #ifdef STANDALONE_SOLVER
-                if (solver_show_working)
+                /*
+                 * The depth only matters to the diagnostics. Solvers
+                 * on worker threads never show working, so keeping
+                 * it only then stops them all writing to it.
+                 */
+                if (solver_show_working) {
                     printf("%*sguessing %d at (%d,%d)\n",
                            solver_recurse_depth*4, "", list[i], x + 1, y + 1);
-                solver_recurse_depth++;
+                    solver_recurse_depth++;
+                }
 #endif
 
-                solver(cr, blocks, kblocks, xtype, outgrid, kgrid, dlev);
+                if (usage->kclues) {
+                    copy_block_structure(usage->kblocks, usage->kblocks_orig);
+                    memcpy(usage->kclues, usage->kclues_orig, cr*cr);
+                }
+                solver_place(usage, x, y, list[i]);
+                solver_search(usage, scratch, dlev);
+                solver_undo(usage, mark);
 
 #ifdef STANDALONE_SOLVER
-                solver_recurse_depth--;
                 if (solver_show_working) {
+                    solver_recurse_depth--;
                     printf("%*sretracting %d at (%d,%d)\n",
                            solver_recurse_depth*4, "", list[i], x + 1, y + 1);
                 }
 #endif
 
-                /*
-                 * If we have our first solution, copy it into the
-                 * grid we will return.
-                 */
-                if (diff == DIFF_IMPOSSIBLE && dlev->diff != DIFF_IMPOSSIBLE)
-                    memcpy(grid, outgrid, cr*cr);
-
                 if (dlev->diff == DIFF_AMBIGUOUS)
                     diff = DIFF_AMBIGUOUS;
                 else if (dlev->diff == DIFF_IMPOSSIBLE)
@@ -2621,8 +3011,6 @@ static void solver(int cr, struct block_structure *blocks,
                     break;
             }
 
-            sfree(outgrid);
-            sfree(ingrid);
             sfree(list);
         }
 
@@ -2650,26 +3038,478 @@ static void solver(int cr, struct block_structure *blocks,
                diff == DIFF_AMBIGUOUS ? "multiple solutions" :
                "one solution");
 #endif
+}
 
-    sfree(usage->sq2region);
-    sfree(usage->regions);
-    sfree(usage->cube);
-    sfree(usage->row);
-    sfree(usage->col);
-    sfree(usage->blk);
-    if (usage->kblocks) {
-        free_block_structure(usage->kblocks);
-        free_block_structure(usage->extra_cages);
-        sfree(usage->extra_clues);
+/* ----------------------------------------------------------------------
+ * End of solver code.
+ */
+
+/* ----------------------------------------------------------------------
+ * Exact-cover solution counter.
+ *
+ * The solver above is what grades a puzzle, but when all we want
+ * to know is whether a grid has exactly one solution it is a
+ * needlessly expensive way to find out: every level of its
+ * recursion copies the grid and rebuilds the whole reasoning state
+ * from scratch. Sudoku is a natural exact cover problem, so this
+ * is a straightforward implementation of Knuth's Algorithm X using
+ * dancing links, which stops as soon as it has seen enough
+ * solutions to answer the question.
+ *
+ * The matrix has one row for each (square, digit) pair that the
+ * clues don't rule out, and primary columns for `square is
+ * filled', `row has digit', `column has digit', `block has digit'
+ * and, in X-type puzzles, `diagonal has digit'. Killer cages get a
+ * secondary column for each (cage, digit) pair, since a cage may
+ * not contain any digit twice but need not contain them all. Cage
+ * sums can't be expressed as exact cover at all, so they are
+ * checked during the search instead: after each placement we make
+ * sure the cage's remaining total is still reachable by the
+ * digits it has left.
+ */
+struct dlx {
+    int cr, area;
+
+    /*
+     * Node storage. Node 0 is the root, nodes 1..ncols are the
+     * column headers, and matrix entries follow. colsize is indexed
+     * by column header, and node_row gives the matrix row each
+     * entry belongs to.
+     */
+    int *left, *right, *up, *down, *col, *colsize, *node_row;
+    int maxcols, ncols, nnodes;
+    bool *taken;
+
+    /* The square and digit each matrix row stands for. */
+    int *row_square;
+    digit *row_digit;
+
+    /*
+     * Killer cage state: the cages themselves, the sum each still
+     * has to make up, the number of its squares still empty, and
+     * which digits (indexed cage*cr + digit-1) it already uses.
+     * placed[] holds the digit in each square so far. Rows that a
+     * cage sum has ruled out are hidden from their columns, and
+     * recorded in hidden[] so that they can be put back.
+     */
+    struct block_structure *cages;
+    int *cage_sum, *cage_left;
+    bool *cage_used;
+    digit *placed;
+    int *hidden, nhidden;
+
+    /* Search state. */
+    int *chosen;
+    int nsolutions, limit;
+    digit *solution;
+};
+
+static struct dlx *dlx_new(int cr, bool killer)
+{
+    struct dlx *d = snew(struct dlx);
+    int area = cr*cr;
+    int maxnodes;
+
+    d->cr = cr;
+    d->area = area;
+    /* square, row, column and block columns, then diagonals and cages */
+    d->maxcols = 4*area + 2*cr + (killer ? area*cr : 0);
+    /* at most 7 entries per row: four, two diagonals and a cage */
+    maxnodes = 1 + d->maxcols + 7*area*cr;
+
+    d->left = snewn(maxnodes, int);
+    d->right = snewn(maxnodes, int);
+    d->up = snewn(maxnodes, int);
+    d->down = snewn(maxnodes, int);
+    d->col = snewn(maxnodes, int);
+    d->node_row = snewn(maxnodes, int);
+    d->colsize = snewn(1 + d->maxcols, int);
+    d->taken = snewn(1 + d->maxcols, bool);
+    d->row_square = snewn(area*cr, int);
+    d->row_digit = snewn(area*cr, digit);
+    if (killer) {
+        d->cage_sum = snewn(area, int);
+        d->cage_left = snewn(area, int);
+        d->cage_used = snewn(area*cr, bool);
+        d->placed = snewn(area, digit);
+        d->hidden = snewn(area*cr, int);
+    } else {
+        d->cage_sum = d->cage_left = d->hidden = NULL;
+        d->cage_used = NULL;
+        d->placed = NULL;
     }
-    if (usage->kclues) sfree(usage->kclues);
-    sfree(usage);
+    d->cages = NULL;
+    d->chosen = snewn(area, int);
+
+    return d;
+}
+
+static void dlx_free(struct dlx *d)
+{
+    sfree(d->left);
+    sfree(d->right);
+    sfree(d->up);
+    sfree(d->down);
+    sfree(d->col);
+    sfree(d->node_row);
+    sfree(d->colsize);
+    sfree(d->taken);
+    sfree(d->row_square);
+    sfree(d->row_digit);
+    sfree(d->cage_sum);
+    sfree(d->cage_left);
+    sfree(d->cage_used);
+    sfree(d->placed);
+    sfree(d->hidden);
+    sfree(d->chosen);
+    sfree(d);
+}
+
+static void dlx_cover(struct dlx *d, int c)
+{
+    int i, j;
+
+    d->right[d->left[c]] = d->right[c];
+    d->left[d->right[c]] = d->left[c];
+    for (i = d->down[c]; i != c; i = d->down[i])
+        for (j = d->right[i]; j != i; j = d->right[j]) {
+            d->down[d->up[j]] = d->down[j];
+            d->up[d->down[j]] = d->up[j];
+            d->colsize[d->col[j]]--;
+        }
+}
+
+static void dlx_uncover(struct dlx *d, int c)
+{
+    int i, j;
+
+    for (i = d->up[c]; i != c; i = d->up[i])
+        for (j = d->left[i]; j != i; j = d->left[j]) {
+            d->colsize[d->col[j]]++;
+            d->down[d->up[j]] = j;
+            d->up[d->down[j]] = j;
+        }
+    d->right[d->left[c]] = c;
+    d->left[d->right[c]] = c;
+}
+
+/*
+ * Decide whether m distinct digits, none of them marked in `used'
+ * and none bigger than `top', can add up to `sum'. This is what
+ * keeps a killer cage honest: after every placement in it, the
+ * rest of the cage must still be able to make up its total.
+ */
+static bool dlx_sum_possible(const bool *used, int top, int m, int sum)
+{
+    if (m == 0)
+        return sum == 0;
+    if (top < m || sum < m*(m+1)/2 || sum > m*(2*top-m+1)/2)
+        return false;
+    if (!used[top-1] && top <= sum &&
+        dlx_sum_possible(used, top-1, m-1, sum-top))
+        return true;
+    return dlx_sum_possible(used, top-1, m, sum);
+}
+
+static void dlx_hide_row(struct dlx *d, int i)
+{
+    int j = i;
+
+    do {
+        d->down[d->up[j]] = d->down[j];
+        d->up[d->down[j]] = d->up[j];
+        d->colsize[d->col[j]]--;
+        j = d->right[j];
+    } while (j != i);
+}
+
+static void dlx_unhide_row(struct dlx *d, int i)
+{
+    int j = i;
+
+    do {
+        j = d->left[j];
+        d->colsize[d->col[j]]++;
+        d->down[d->up[j]] = j;
+        d->up[d->down[j]] = j;
+    } while (j != i);
+}
+
+/*
+ * Account for a placement in its killer cage. Returns false if the
+ * cage can no longer make up its sum; otherwise hides every row
+ * for the cage's other empty squares whose digit would leave the
+ * sum unreachable. Either way dlx_cage_unplace() undoes the lot.
+ */
+static bool dlx_cage_place(struct dlx *d, int r)
+{
+    int cr = d->cr;
+    int sq = d->row_square[r], n = d->row_digit[r];
+    int k = d->cages->whichblock[sq];
+    bool *used = d->cage_used + k*cr;
+    int i, j;
+
+    d->cage_sum[k] -= n;
+    d->cage_left[k]--;
+    used[n-1] = true;
+    d->placed[sq] = n;
+    if (!dlx_sum_possible(used, cr, d->cage_left[k], d->cage_sum[k]))
+        return false;
+
+    for (j = 0; j < d->cages->nr_squares[k]; j++) {
+        int sq2 = d->cages->blocks[k][j], c = 1 + sq2;
+
+        if (d->placed[sq2])
+            continue;
+        for (i = d->down[c]; i != c; i = d->down[i]) {
+            int m = d->row_digit[d->node_row[i]];
+            bool ok;
+
+            used[m-1] = true;
+            ok = dlx_sum_possible(used, cr, d->cage_left[k] - 1,
+                                  d->cage_sum[k] - m);
+            used[m-1] = false;
+            if (!ok) {
+                dlx_hide_row(d, i);
+                d->hidden[d->nhidden++] = i;
+            }
+        }
+    }
+    return true;
+}
 
-    solver_free_scratch(scratch);
+static void dlx_cage_unplace(struct dlx *d, int r, int nhidden)
+{
+    int sq = d->row_square[r], n = d->row_digit[r];
+    int k = d->cages->whichblock[sq];
+
+    while (d->nhidden > nhidden)
+        dlx_unhide_row(d, d->hidden[--d->nhidden]);
+    d->cage_sum[k] += n;
+    d->cage_left[k]++;
+    d->cage_used[k*d->cr + n-1] = false;
+    d->placed[sq] = 0;
+}
+
+static void dlx_search(struct dlx *d, int depth)
+{
+    int c, i, j, best, r;
+
+    if (d->right[0] == 0) {
+        if (d->nsolutions++ == 0 && d->solution)
+            for (i = 0; i < depth; i++)
+                d->solution[d->row_square[d->chosen[i]]] =
+                    d->row_digit[d->chosen[i]];
+        return;
+    }
+
+    /*
+     * Branch on the column with the fewest remaining rows.
+     */
+    best = -1;
+    for (c = d->right[0]; c != 0; c = d->right[c])
+        if (best < 0 || d->colsize[c] < d->colsize[best]) {
+            best = c;
+            if (d->colsize[c] <= 1)
+                break;
+        }
+    if (d->colsize[best] == 0)
+        return;
+
+    dlx_cover(d, best);
+    for (i = d->down[best]; i != best; i = d->down[i]) {
+        int nhidden = d->nhidden;
+
+        r = d->node_row[i];
+        d->chosen[depth] = r;
+        for (j = d->right[i]; j != i; j = d->right[j])
+            dlx_cover(d, d->col[j]);
+        if (!d->cages || dlx_cage_place(d, r))
+            dlx_search(d, depth+1);
+        if (d->cages)
+            dlx_cage_unplace(d, r, nhidden);
+        for (j = d->left[i]; j != i; j = d->left[j])
+            dlx_uncover(d, d->col[j]);
+
+        if (d->nsolutions >= d->limit)
+            break;
+    }
+    dlx_uncover(d, best);
+}
+
+/*
+ * Count the solutions of a grid, stopping once `limit' of them
+ * have been found; so passing limit 2 answers `none, one or many'.
+ * If `solution' is non-NULL, the first solution found is written
+ * to it. kblocks and kgrid may be NULL for non-killer puzzles.
+ */
+static int dlx_count_solutions(struct dlx *d, struct block_structure *blocks,
+                               struct block_structure *kblocks, bool xtype,
+                               digit *grid, digit *kgrid, int limit,
+                               digit *solution)
+{
+    int cr = d->cr, area = d->area;
+    int cols[7], ncols;
+    int c, i, j, n, b, prev, nrows, nprimary;
+
+    nprimary = 4*area + (xtype ? 2*cr : 0);
+    d->ncols = nprimary + (kblocks ? kblocks->nr_blocks * cr : 0);
+    assert(d->ncols <= d->maxcols);
+
+#define DLX_COLUMNS(sq, n) do { \
+        int x_ = (sq) % cr, y_ = (sq) / cr; \
+        ncols = 0; \
+        cols[ncols++] = 1 + (sq); \
+        cols[ncols++] = 1 + area + y_*cr + (n)-1; \
+        cols[ncols++] = 1 + 2*area + x_*cr + (n)-1; \
+        cols[ncols++] = 1 + 3*area + blocks->whichblock[sq]*cr + (n)-1; \
+        if (xtype && ondiag0(sq)) \
+            cols[ncols++] = 1 + 4*area + (n)-1; \
+        if (xtype && ondiag1(sq)) \
+            cols[ncols++] = 1 + 4*area + cr + (n)-1; \
+        if (kblocks) \
+            cols[ncols++] = 1 + nprimary + kblocks->whichblock[sq]*cr + (n)-1; \
+    } while (0)
+
+    /*
+     * The clues are applied before the matrix is built: every
+     * column a clue satisfies is marked as taken, and will neither
+     * appear in the matrix nor admit any row that clashes with the
+     * clue. Two clues clashing with each other means there is no
+     * solution at all.
+     */
+    for (c = 0; c <= d->ncols; c++)
+        d->taken[c] = false;
+    for (i = 0; i < area; i++)
+        if (grid[i]) {
+            DLX_COLUMNS(i, grid[i]);
+            for (j = 0; j < ncols; j++) {
+                if (d->taken[cols[j]])
+                    return 0;
+                d->taken[cols[j]] = true;
+            }
+        }
+
+    if (kblocks) {
+        d->cages = kblocks;
+        d->nhidden = 0;
+        memcpy(d->placed, grid, area);
+        for (b = 0; b < kblocks->nr_blocks; b++) {
+            d->cage_sum[b] = 0;
+            d->cage_left[b] = 0;
+            for (n = 0; n < cr; n++)
+                d->cage_used[b*cr+n] = false;
+            for (i = 0; i < kblocks->nr_squares[b]; i++) {
+                int sq = kblocks->blocks[b][i];
+                if (kgrid[sq])
+                    d->cage_sum[b] += kgrid[sq];
+                if (grid[sq]) {
+                    d->cage_sum[b] -= grid[sq];
+                    d->cage_used[b*cr + grid[sq]-1] = true;
+                } else
+                    d->cage_left[b]++;
+            }
+            if (!dlx_sum_possible(d->cage_used + b*cr, cr,
+                                  d->cage_left[b], d->cage_sum[b]))
+                return 0;
+        }
+    } else
+        d->cages = NULL;
+
+    /*
+     * Set up the column headers. Primary columns still to be
+     * satisfied are linked into the root's list; secondary ones
+     * point at themselves so that covering them is harmless and
+     * they are never chosen to branch on.
+     */
+    prev = 0;
+    for (c = 1; c <= d->ncols; c++) {
+        d->up[c] = d->down[c] = d->col[c] = c;
+        d->colsize[c] = 0;
+        if (c <= nprimary && !d->taken[c]) {
+            d->left[c] = prev;
+            d->right[prev] = c;
+            prev = c;
+        } else
+            d->left[c] = d->right[c] = c;
+    }
+    d->right[prev] = 0;
+    d->left[0] = prev;
+    d->nnodes = d->ncols + 1;
+
+    /*
+     * Now build a matrix row for each digit that could go in each
+     * empty square. In a killer cage we also leave out any digit
+     * that the rest of the cage couldn't make up the total around.
+     */
+    nrows = 0;
+    for (i = 0; i < area; i++) {
+        if (grid[i])
+            continue;
+        for (n = 1; n <= cr; n++) {
+            int first = -1;
+
+            DLX_COLUMNS(i, n);
+            for (j = 0; j < ncols; j++)
+                if (d->taken[cols[j]])
+                    break;
+            if (j < ncols)
+                continue;
+            if (kblocks) {
+                int k = kblocks->whichblock[i];
+                bool ok;
+
+                d->cage_used[k*cr + n-1] = true;
+                ok = dlx_sum_possible(d->cage_used + k*cr, cr,
+                                      d->cage_left[k] - 1,
+                                      d->cage_sum[k] - n);
+                d->cage_used[k*cr + n-1] = false;
+                if (!ok)
+                    continue;
+            }
+
+            d->row_square[nrows] = i;
+            d->row_digit[nrows] = n;
+            for (j = 0; j < ncols; j++) {
+                int node = d->nnodes++;
+
+                c = cols[j];
+                d->col[node] = c;
+                d->node_row[node] = nrows;
+                d->up[node] = d->up[c];
+                d->down[node] = c;
+                d->down[d->up[c]] = node;
+                d->up[c] = node;
+                d->colsize[c]++;
+
+                if (first < 0) {
+                    first = node;
+                    d->left[node] = d->right[node] = node;
+                } else {
+                    d->left[node] = d->left[first];
+                    d->right[node] = first;
+                    d->right[d->left[first]] = node;
+                    d->left[first] = node;
+                }
+            }
+            nrows++;
+        }
+    }
+
+#undef DLX_COLUMNS
+
+    if (solution)
+        memcpy(solution, grid, area);
+    d->nsolutions = 0;
+    d->limit = limit;
+    d->solution = solution;
+    dlx_search(d, 0);
+
+    return d->nsolutions;
 }
 
 /* ----------------------------------------------------------------------
- * End of solver code.
+ * End of exact-cover code.
  */
 
 /* ----------------------------------------------------------------------
@@ -2701,9 +3541,20 @@ static void solver(int cr, struct block_structure *blocks,
  * of possibilities for other squares and hence reduce the enormous
  * search space as much as possible as early as possible.
  *
- * The use of bit sets implies that we support puzzles up to a size of
- * 32x32 (less if anyone finds a 16-bit machine to compile this on).
+ * The bit sets are single candset words, like the solver's, which
+ * is why SYMBOLS_MAX must stay within CANDSET_BITS.
+ *
+ * Beyond the orders we've always supported, picking squares alone
+ * thrashes: an early choice can leave a row, column, block or
+ * diagonal with nowhere to put some digit, and the search takes an
+ * enormous number of steps to back out of that. So for those orders
+ * it also counts the places each missing digit has left in each
+ * house. A digit with none means backtracking at once, and a digit
+ * with just one goes there before any square is tried. Smaller
+ * orders keep the plain search, so existing random seeds still give
+ * the same grids.
  */
+#define GRIDGEN_LOOKAHEAD_ORDER 32
 
 /*
  * Internal data structure used in gridgen to keep track of
@@ -2716,14 +3567,21 @@ struct gridgen_usage {
     /* grid is a copy of the input grid, modified as we go along */
     digit *grid;
     /*
-     * Bitsets.  In each of them, bit n is set if digit n has been placed
-     * in the corresponding region.  row, col and blk are used for all
-     * puzzles.  cge is used only for killer puzzles, and diag is used
-     * only for x-type puzzles.
+     * Bitsets.  In each of them, bit n-1 is set if digit n has been
+     * placed in the corresponding region.  row, col and blk are used
+     * for all puzzles.  cge is used only for killer puzzles, and diag
+     * is used only for x-type puzzles.
      * All of these have cr entries, except diag which only has 2,
      * and cge, which has as many entries as kblocks.
      */
-    unsigned int *row, *col, *blk, *cge, *diag;
+    candset *row, *col, *blk, *cge, *diag;
+    /*
+     * Look-ahead for large orders (NULL otherwise): for each house,
+     * numbered rows, columns, blocks, diagonals, the digits with at
+     * least one free place in it, and those with at least two.
+     */
+    int nhouses;
+    candset *once, *twice;
     /* This lists all the empty spaces remaining in the grid. */
     struct gridgen_coord *spaces;
     int nspaces;
@@ -2733,7 +3591,7 @@ struct gridgen_usage {
 
 static void gridgen_place(struct gridgen_usage *usage, int x, int y, digit n)
 {
-    unsigned int bit = 1 << n;
+    candset bit = CANDBIT(n-1);
     int cr = usage->cr;
     usage->row[y] |= bit;
     usage->col[x] |= bit;
@@ -2751,7 +3609,7 @@ static void gridgen_place(struct gridgen_usage *usage, int x, int y, digit n)
 
 static void gridgen_remove(struct gridgen_usage *usage, int x, int y, digit n)
 {
-    unsigned int mask = ~(1 << n);
+    candset mask = ~CANDBIT(n-1);
     int cr = usage->cr;
     usage->row[y] &= mask;
     usage->col[x] &= mask;
@@ -2767,21 +3625,127 @@ static void gridgen_remove(struct gridgen_usage *usage, int x, int y, digit n)
     usage->grid[y*cr+x] = 0;
 }
 
-#define N_SINGLE 32
-
 /*
- * The real recursive step in the generating function.
- *
- * Return values: 1 means solution found, 0 means no solution
- * found on this branch.
+ * The digits already placed in the houses of square (x,y).
  */
-static bool gridgen_real(struct gridgen_usage *usage, digit *grid, int *steps)
+static candset gridgen_used(struct gridgen_usage *usage, int x, int y)
 {
-    int cr = usage->cr;
-    int i, j, n, sx, sy, bestm, bestr;
+    int cr = usage->cr, xy = y*cr+x;
+    candset used;
+
+    used = usage->row[y] | usage->col[x] |
+        usage->blk[usage->blocks->whichblock[xy]];
+    if (usage->cge)
+        used |= usage->cge[usage->kblocks->whichblock[xy]];
+    if (usage->diag) {
+        if (ondiag0(xy))
+            used |= usage->diag[0];
+        if (ondiag1(xy))
+            used |= usage->diag[1];
+    }
+    return used;
+}
+
+/*
+ * The bit set of digits placed in house h, and the ith square of it.
+ */
+static candset gridgen_house_set(struct gridgen_usage *usage, int h)
+{
+    int cr = usage->cr;
+
+    if (h < cr)
+        return usage->row[h];
+    if (h < 2*cr)
+        return usage->col[h-cr];
+    if (h < 3*cr)
+        return usage->blk[h-2*cr];
+    return usage->diag[h-3*cr];
+}
+
+static int gridgen_house_square(struct gridgen_usage *usage, int h, int i)
+{
+    int cr = usage->cr;
+
+    if (h < cr)
+        return h*cr + i;
+    if (h < 2*cr)
+        return i*cr + (h-cr);
+    if (h < 3*cr)
+        return usage->blocks->blocks[h-2*cr][i];
+    return (h == 3*cr ? diag0(i) : diag1(i));
+}
+
+/*
+ * Count the digits free at (x,y), given those used around it, into
+ * the place counts of its houses.
+ */
+static void gridgen_count(struct gridgen_usage *usage, int x, int y,
+                          candset used)
+{
+    int cr = usage->cr;
+    int h[5], nh = 0, k;
+
+    h[nh++] = y;
+    h[nh++] = cr + x;
+    h[nh++] = 2*cr + usage->blocks->whichblock[y*cr+x];
+    if (usage->diag) {
+        if (ondiag0(y*cr+x))
+            h[nh++] = 3*cr;
+        if (ondiag1(y*cr+x))
+            h[nh++] = 3*cr+1;
+    }
+    for (k = 0; k < nh; k++) {
+        usage->twice[h[k]] |= usage->once[h[k]] & ~used;
+        usage->once[h[k]] |= ~used;
+    }
+}
+
+/*
+ * After gridgen_count() has seen every space: return -1 if some
+ * house has nowhere left for a digit it still needs, or else a
+ * digit with only one place left in some house, storing that
+ * square in *xy, or 0 if there isn't one.
+ */
+static int gridgen_lookahead(struct gridgen_usage *usage, int *xy)
+{
+    int cr = usage->cr;
+    int h, i, n;
+
+    for (h = 0; h < usage->nhouses; h++)
+        if (~gridgen_house_set(usage, h) & CANDALL(cr) & ~usage->once[h])
+            return -1;
+
+    for (h = 0; h < usage->nhouses; h++) {
+        candset single = usage->once[h] & ~usage->twice[h] &
+            ~gridgen_house_set(usage, h) & CANDALL(cr);
+        if (!single)
+            continue;
+        n = cand_first(single);
+        for (i = 0; i < cr; i++) {
+            *xy = gridgen_house_square(usage, h, i);
+            if (usage->grid[*xy])
+                continue;
+            if (!(gridgen_used(usage, *xy % cr, *xy / cr) & CANDBIT(n)))
+                return n + 1;
+        }
+        assert(!"digit counted in house but not found");
+    }
+    return 0;
+}
+
+/*
+ * The real recursive step in the generating function.
+ *
+ * Return values: 1 means solution found, 0 means no solution
+ * found on this branch.
+ */
+static bool gridgen_real(struct gridgen_usage *usage, digit *grid, int *steps)
+{
+    int cr = usage->cr;
+    int i, j, n, sx, sy, bestm, bestr;
+    candset used, bestused, avail;
     bool ret;
     int *digits;
-    unsigned int used;
 
     /*
      * Firstly, check for completion! If there are no spaces left
@@ -2803,42 +3767,50 @@ static bool gridgen_real(struct gridgen_usage *usage, digit *grid, int *steps)
      */
     bestm = cr+1;                       /* so that any space will beat it */
     bestr = 0;
-    used = ~0;
     i = sx = sy = -1;
+    bestused = 0;
+    if (usage->once) {
+        memset(usage->once, 0, usage->nhouses * sizeof *usage->once);
+        memset(usage->twice, 0, usage->nhouses * sizeof *usage->twice);
+    }
     for (j = 0; j < usage->nspaces; j++) {
         int x = usage->spaces[j].x, y = usage->spaces[j].y;
-        unsigned int used_xy;
         int m;
 
-        m = usage->blocks->whichblock[y*cr+x];
-        used_xy = usage->row[y] | usage->col[x] | usage->blk[m];
-        if (usage->cge != NULL)
-            used_xy |= usage->cge[usage->kblocks->whichblock[y*cr+x]];
-        if (usage->cge != NULL)
-            used_xy |= usage->cge[usage->kblocks->whichblock[y*cr+x]];
-        if (usage->diag != NULL) {
-            if (ondiag0(y*cr+x))
-                used_xy |= usage->diag[0];
-            if (ondiag1(y*cr+x))
-                used_xy |= usage->diag[1];
-        }
-
         /*
          * Find the number of digits that could go in this space.
          */
-        m = 0;
-        for (n = 1; n <= cr; n++) {
-            unsigned int bit = 1 << n;
-            if ((used_xy & bit) == 0)
-                m++;
-        }
+        used = gridgen_used(usage, x, y);
+        m = cr - cand_count(used);
+        if (usage->once)
+            gridgen_count(usage, x, y, used);
         if (m < bestm || (m == bestm && usage->spaces[j].r < bestr)) {
             bestm = m;
             bestr = usage->spaces[j].r;
             sx = x;
             sy = y;
             i = j;
-            used = used_xy;
+            bestused = used;
+        }
+    }
+
+    /*
+     * For large orders, see if the houses rule out or force
+     * anything the squares alone didn't show.
+     */
+    if (usage->once && bestm > 1) {
+        int xy;
+
+        n = gridgen_lookahead(usage, &xy);
+        if (n < 0)
+            return false;
+        if (n > 0) {
+            sx = xy % cr;
+            sy = xy / cr;
+            for (i = 0; usage->spaces[i].x != sx || usage->spaces[i].y != sy;
+                 i++);
+            bestm = 1;
+            bestused = ~CANDBIT(n-1);
         }
     }
 
@@ -2861,12 +3833,8 @@ static bool gridgen_real(struct gridgen_usage *usage, digit *grid, int *steps)
     digits = snewn(bestm, int);
 
     j = 0;
-    for (n = 1; n <= cr; n++) {
-        unsigned int bit = 1 << n;
-
-        if ((used & bit) == 0)
-            digits[j++] = n;
-    }
+    for (avail = ~bestused & CANDALL(cr); avail; avail &= avail-1)
+        digits[j++] = cand_first(avail) + 1;
 
     if (usage->rs)
         shuffle(digits, j, sizeof(*digits), usage->rs);
@@ -2922,12 +3890,13 @@ static bool gridgen(int cr, struct block_structure *blocks,
 
     usage->grid = grid;
 
-    usage->row = snewn(cr, unsigned int);
-    usage->col = snewn(cr, unsigned int);
-    usage->blk = snewn(cr, unsigned int);
+    assert(cr <= CANDSET_BITS);
+    usage->row = snewn(cr, candset);
+    usage->col = snewn(cr, candset);
+    usage->blk = snewn(cr, candset);
     if (kblocks != NULL) {
         usage->kblocks = kblocks;
-        usage->cge = snewn(usage->kblocks->nr_blocks, unsigned int);
+        usage->cge = snewn(kblocks->nr_blocks, candset);
         memset(usage->cge, 0, kblocks->nr_blocks * sizeof *usage->cge);
     } else {
         usage->cge = NULL;
@@ -2938,12 +3907,20 @@ static bool gridgen(int cr, struct block_structure *blocks,
     memset(usage->blk, 0, cr * sizeof *usage->blk);
 
     if (xtype) {
-        usage->diag = snewn(2, unsigned int);
+        usage->diag = snewn(2, candset);
         memset(usage->diag, 0, 2 * sizeof *usage->diag);
     } else {
         usage->diag = NULL;
     }
 
+    usage->nhouses = 3*cr + (xtype ? 2 : 0);
+    if (cr >= GRIDGEN_LOOKAHEAD_ORDER) {
+        usage->once = snewn(usage->nhouses, candset);
+        usage->twice = snewn(usage->nhouses, candset);
+    } else {
+        usage->once = usage->twice = NULL;
+    }
+
     /*
      * Begin by filling in the whole top row with randomly chosen
      * numbers. This cannot introduce any bias or restriction on
@@ -2984,6 +3961,9 @@ static bool gridgen(int cr, struct block_structure *blocks,
      * Clean up the usage structure now we have our answer.
      */
     sfree(usage->spaces);
+    sfree(usage->twice);
+    sfree(usage->once);
+    sfree(usage->diag);
     sfree(usage->cge);
     sfree(usage->blk);
     sfree(usage->col);
@@ -3454,70 +4434,86 @@ static void merge_blocks(struct block_structure *b, int n1, int n2)
     b->nr_blocks = n1;
 }
 
-static bool merge_some_cages(struct block_structure *b, int cr, int area,
-                             digit *grid, random_state *rs)
+/*
+ * A pair of Killer cages which share an edge, with b1 < b2.
+ */
+struct cage_pair {
+    int b1, b2;
+};
+
+/*
+ * List every pair of adjacent cages once, in order of the lower
+ * cage number. mark is scratch space of one int per cage.
+ */
+static int find_cage_pairs(struct block_structure *b, int cr,
+                           struct cage_pair *pairs, int *mark)
 {
-    /*
-     * Make a list of all the pairs of adjacent blocks.
-     */
-    int i, j, k;
-    struct pair {
-        int b1, b2;
-    } *pairs;
-    int npairs;
+    int i, j, k, d;
+    int npairs = 0;
 
-    pairs = snewn(b->nr_blocks * b->nr_blocks, struct pair);
-    npairs = 0;
+    for (i = 0; i < b->nr_blocks; i++)
+        mark[i] = -1;
 
     for (i = 0; i < b->nr_blocks; i++) {
-        for (j = i+1; j < b->nr_blocks; j++) {
-
-            /*
-             * Rule the merger out of consideration if it's
-             * obviously not viable.
-             */
-            if (b->nr_squares[i] + b->nr_squares[j] > b->max_nr_squares)
-                continue;               /* we couldn't merge these anyway */
-
-            /*
-             * See if these two blocks have a pair of squares
-             * adjacent to each other.
-             */
-            for (k = 0; k < b->nr_squares[i]; k++) {
-                int xy = b->blocks[i][k];
-                int y = xy / cr, x = xy % cr;
-                if ((y   > 0  && b->whichblock[xy - cr] == j) ||
-                    (y+1 < cr && b->whichblock[xy + cr] == j) ||
-                    (x   > 0  && b->whichblock[xy -  1] == j) ||
-                    (x+1 < cr && b->whichblock[xy +  1] == j)) {
-                    /*
-                     * Yes! Add this pair to our list.
-                     */
+        for (k = 0; k < b->nr_squares[i]; k++) {
+            int xy = b->blocks[i][k];
+            int y = xy / cr, x = xy % cr;
+
+            for (d = 0; d < 4; d++) {
+                if (d == 0 && y > 0)
+                    j = b->whichblock[xy - cr];
+                else if (d == 1 && y+1 < cr)
+                    j = b->whichblock[xy + cr];
+                else if (d == 2 && x > 0)
+                    j = b->whichblock[xy - 1];
+                else if (d == 3 && x+1 < cr)
+                    j = b->whichblock[xy + 1];
+                else
+                    continue;
+                if (j > i && mark[j] != i) {
+                    mark[j] = i;
                     pairs[npairs].b1 = i;
                     pairs[npairs].b2 = j;
-                    break;
+                    npairs++;
                 }
             }
         }
     }
 
-    /*
-     * Now go through that list in random order until we find a pair
-     * of blocks we can merge.
-     */
-    while (npairs > 0) {
-        int n1, n2;
+    return npairs;
+}
+
+/*
+ * Merge a random pair of cages from the list of adjacent pairs, and
+ * bring the list up to date with the renumbering done by
+ * merge_blocks(). Pairs which turn out not to be viable are dropped
+ * for good on the way, since cages only ever grow. The pair merged
+ * is returned in *merged.
+ */
+static bool merge_some_cages(struct block_structure *b, digit *grid,
+                             struct cage_pair *pairs, int *npairs,
+                             int *mark, struct cage_pair *merged,
+                             random_state *rs)
+{
+    int i, j;
+
+    while (*npairs > 0) {
+        int n1, n2, last;
         unsigned int digits_found;
 
         /*
          * Pick a random pair, and remove it from the list.
          */
-        i = random_upto(rs, npairs);
+        i = random_upto(rs, *npairs);
         n1 = pairs[i].b1;
         n2 = pairs[i].b2;
-        if (i != npairs-1)
-            pairs[i] = pairs[npairs-1];
-        npairs--;
+        pairs[i] = pairs[--*npairs];
+
+        /*
+         * Rule the merger out if it's obviously not viable.
+         */
+        if (b->nr_squares[n1] + b->nr_squares[n2] > b->max_nr_squares)
+            continue;
 
         /* Guarantee that the merged cage would still be a region.  */
         digits_found = 0;
@@ -3530,32 +4526,58 @@ static bool merge_some_cages(struct block_structure *b, int cr, int area,
             continue;
 
         /*
-         * Got one! Do the merge.
+         * Got one! Do the merge. merge_blocks() folds n2 into n1
+         * and then moves the last cage into n2's slot, so renumber
+         * the remaining pairs to match, and weed out the duplicates
+         * left where a cage was next to both n1 and n2.
          */
         merge_blocks(b, n1, n2);
-        sfree(pairs);
+        last = b->nr_blocks;
+        for (i = 0; i < b->nr_blocks; i++)
+            mark[i] = -1;
+        for (i = j = 0; i < *npairs; i++) {
+            struct cage_pair p = pairs[i];
+
+            if (p.b1 == n2) p.b1 = n1; else if (p.b1 == last) p.b1 = n2;
+            if (p.b2 == n2) p.b2 = n1; else if (p.b2 == last) p.b2 = n2;
+            if (p.b1 > p.b2) {
+                int t = p.b1;
+                p.b1 = p.b2;
+                p.b2 = t;
+            }
+            if (p.b1 == n1 || p.b2 == n1) {
+                int other = (p.b1 == n1 ? p.b2 : p.b1);
+                if (mark[other] == n1)
+                    continue;
+                mark[other] = n1;
+            }
+            pairs[j++] = p;
+        }
+        *npairs = j;
+
+        merged->b1 = n1;
+        merged->b2 = n2;
         return true;
     }
 
-    sfree(pairs);
     return false;
 }
 
 static void compute_kclues(struct block_structure *cages, digit *kclues,
                            digit *grid, int area)
 {
-    int i;
+    int i, k;
     memset(kclues, 0, area * sizeof *kclues);
     for (i = 0; i < cages->nr_blocks; i++) {
-        int j, sum = 0;
-        for (j = 0; j < area; j++)
-            if (cages->whichblock[j] == i)
-                sum += grid[j];
-        for (j = 0; j < area; j++)
-            if (cages->whichblock[j] == i)
-                break;
-        assert (j != area);
-        kclues[j] = sum;
+        int first = area, sum = 0;
+        for (k = 0; k < cages->nr_squares[i]; k++) {
+            int xy = cages->blocks[i][k];
+            sum += grid[xy];
+            if (xy < first)
+                first = xy;
+        }
+        assert (first != area);
+        kclues[first] = sum;
     }
 }
 
@@ -3632,17 +4654,47 @@ static struct block_structure *gen_killer_cages(int cr, random_state *rs,
     return b;
 }
 
+/*
+ * The character for digit d (1 <= d <= SYMBOLS_MAX).
+ */
+static char digit_char(int d)
+{
+    if (d <= 9)
+        return '0' + d;
+    if (d <= 35)
+        return 'a' + d - 10;
+    return 'A' + d - 36;
+}
+
+/*
+ * The digit typed as character c, or -1 if it isn't one in a puzzle
+ * of order cr. '0' gives 0, to clear a square. Capitals are the same
+ * as lower case until the order is large enough to need them.
+ */
+static int char_digit(int c, int cr)
+{
+    int n;
+
+    if (c >= '0' && c <= '9')
+        n = c - '0';
+    else if (c >= 'a' && c <= 'z')
+        n = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'Z')
+        n = c - 'A' + (cr > 35 ? 36 : 10);
+    else
+        return -1;
+    return n <= cr ? n : -1;
+}
+
 static key_label *game_request_keys(const game_params *params, int *nkeys)
 {
     int i;
     int cr = params->c * params->r;
-    key_label *keys = snewn(cr+1, key_label);
+    key_label *keys = snewn(cr+3, key_label);
     *nkeys = cr + 3;
 
     for (i = 0; i < cr; i++) {
-        if (i<9) keys[i].button = '1' + i;
-        else keys[i].button = 'a' + i - 9;
-
+        keys[i].button = digit_char(i+1);
         keys[i].label = NULL;
     }
     keys[cr].button = '+';
@@ -3656,22 +4708,330 @@ static key_label *game_request_keys(const game_params *params, int *nkeys)
     return keys;
 }
 
-static char *new_game_desc(const game_params *params, random_state *rs,
-                           char **aux, bool interactive)
-{
-    int c = params->c, r = params->r, cr = c*r;
-    int area = cr*cr;
+/*
+ * The working state for generating a puzzle, kept from one attempt
+ * to the next so that it only has to be allocated once.
+ */
+struct solo_gen {
+    const game_params *params;
     struct block_structure *blocks, *kblocks;
     digit *grid, *grid2, *kgrid;
     struct xy { int x, y; } *locs;
+    struct dlx *dlx;                    /* NULL if it would never be used */
+    struct solver_ctx *sctx;            /* made once the blocks are laid out */
+    char *aux;
+    /*
+     * State kept across the clue-removal loop: the solved grid, and
+     * for each row, column, block and diagonal (numbered in that
+     * order) the digits still given as clues in it. The rest is
+     * scratch space for the cheap tests run before each removal.
+     */
+    digit *soln;
+    candset *houses, *hscratch;
+    int *filled;
+    int *linepos;       /* position of each digit along each row/column */
+    /*
+     * Killer mode: the adjacent cage pairs still open for merging in
+     * the current cage layout and in the good and last layouts the
+     * merge loop may fall back to.
+     */
+    struct cage_pair *cpairs, *good_cpairs, *last_cpairs;
+    int *cmark;
+};
+
+static void solo_gen_init(struct solo_gen *g, const game_params *params)
+{
+    int c = params->c, r = params->r, cr = c*r;
+    int area = cr*cr;
+
+    g->params = params;
+    g->grid = snewn(area, digit);
+    g->locs = snewn(area, struct xy);
+    g->grid2 = snewn(area, digit);
+
+    g->blocks = alloc_block_structure (c, r, area, cr, cr);
+
+    g->kblocks = NULL;
+    g->kgrid = (params->killer) ? snewn(area, digit) : NULL;
+    if (params->killer) {
+        g->cpairs = snewn(2*area, struct cage_pair);
+        g->good_cpairs = snewn(2*area, struct cage_pair);
+        g->last_cpairs = snewn(2*area, struct cage_pair);
+        g->cmark = snewn(area, int);
+    } else {
+        g->cpairs = g->good_cpairs = g->last_cpairs = NULL;
+        g->cmark = NULL;
+    }
+    /*
+     * Below Unreasonable, a deductive solve proves uniqueness by
+     * itself, and the exact-cover counter is only there to turn
+     * ambiguous grids away sooner. From order 16 up it costs far
+     * more than it saves (and its tables run to tens of megabytes
+     * at the largest orders), so there we don't build it at all.
+     */
+    if (params->diff >= DIFF_RECURSIVE || cr < 16)
+        g->dlx = dlx_new(cr, params->killer);
+    else
+        g->dlx = NULL;
+    g->sctx = NULL;
+    g->aux = NULL;
+    g->soln = snewn(area, digit);
+    g->houses = snewn(3*cr+2, candset);
+    g->hscratch = snewn(3*cr+2, candset);
+    g->filled = snewn(area, int);
+    g->linepos = snewn(2*area, int);
+}
+
+static void solo_gen_free(struct solo_gen *g)
+{
+    sfree(g->linepos);
+    sfree(g->filled);
+    sfree(g->hscratch);
+    sfree(g->houses);
+    sfree(g->soln);
+    if (g->sctx)
+        solver_ctx_free(g->sctx);
+    if (g->dlx)
+        dlx_free(g->dlx);
+    sfree(g->grid2);
+    sfree(g->locs);
+    sfree(g->grid);
+    free_block_structure(g->blocks);
+    if (g->kblocks)
+        free_block_structure(g->kblocks);
+    sfree(g->kgrid);
+    sfree(g->cmark);
+    sfree(g->last_cpairs);
+    sfree(g->good_cpairs);
+    sfree(g->cpairs);
+    sfree(g->aux);
+}
+
+/*
+ * The houses containing square xy, numbered as in g->houses.
+ */
+static int gen_houses(const struct solo_gen *g, int xy, int *h)
+{
+    int cr = g->params->c * g->params->r;
+    int nh = 0;
+
+    h[nh++] = xy / cr;
+    h[nh++] = cr + xy % cr;
+    h[nh++] = 2*cr + g->blocks->whichblock[xy];
+    if (g->params->xtype) {
+        if (ondiag0(xy))
+            h[nh++] = 3*cr;
+        if (ondiag1(xy))
+            h[nh++] = 3*cr+1;
+    }
+    return nh;
+}
+
+static int gen_house_square(const struct solo_gen *g, int h, int i)
+{
+    int cr = g->params->c * g->params->r;
+
+    if (h < cr)
+        return h*cr + i;
+    if (h < 2*cr)
+        return i*cr + (h-cr);
+    if (h < 3*cr)
+        return g->blocks->blocks[h-2*cr][i];
+    return (h == 3*cr ? diag0(i) : diag1(i));
+}
+
+static candset gen_seen(const struct solo_gen *g, const candset *houses,
+                        int xy)
+{
+    int h[5], nh, k;
+    candset seen = 0;
+
+    nh = gen_houses(g, xy, h);
+    for (k = 0; k < nh; k++)
+        seen |= houses[h[k]];
+    return seen;
+}
+
+/*
+ * Cheap necessary-clue test for the clue-removal loop. grid2 is the
+ * current puzzle with the squares in coords cleared.
+ *
+ * Take a cleared square and another row. Following the digits of the
+ * solution between the two rows picks out a cycle of columns whose
+ * squares in those rows hold the same digits, so exchanging the two
+ * rows within just those columns leaves every row and column valid.
+ * If the exchange also keeps each block (and in X mode, each
+ * diagonal) valid, and every square it touches is empty, the puzzle
+ * has a second solution and the removal is no good. The smallest
+ * such cycles are the familiar a,b / b,a rectangles. The same goes
+ * with rows and columns swapped.
+ */
+static bool gen_removal_ambiguous(struct solo_gen *g, const digit *grid2,
+                                  const int *coords, int ncoords)
+{
+    int cr = g->params->c * g->params->r;
+    const digit *soln = g->soln;
+    candset *acc = g->hscratch;
+    int h[5], nh;
+    int j, k, t, cols, u1, u2;
+
+    for (j = 0; j < ncoords; j++) {
+        for (cols = 0; cols < 2; cols++) {
+            /*
+             * u1 indexes the row (or column) of the cleared square
+             * and t its position along it; u2 is the other line.
+             */
+            u1 = coords[2*j+1-cols];
+            t = coords[2*j+cols];
+            for (u2 = 0; u2 < cr; u2++) {
+                int t0 = t, sq1, sq2;
+                bool ok = true;
+
+                if (u2 == u1)
+                    continue;
+                memset(acc, 0, (3*cr+2) * sizeof(candset));
+                do {
+                    sq1 = cols ? t0*cr+u1 : u1*cr+t0;
+                    sq2 = cols ? t0*cr+u2 : u2*cr+t0;
+                    if (grid2[sq1] || grid2[sq2]) {
+                        ok = false;
+                        break;
+                    }
+                    nh = gen_houses(g, sq1, h);
+                    for (k = 0; k < nh; k++)
+                        acc[h[k]] ^= CANDBIT(soln[sq1]-1) ^
+                            CANDBIT(soln[sq2]-1);
+                    nh = gen_houses(g, sq2, h);
+                    for (k = 0; k < nh; k++)
+                        acc[h[k]] ^= CANDBIT(soln[sq1]-1) ^
+                            CANDBIT(soln[sq2]-1);
+                    t0 = g->linepos[(cols*cr+u1)*cr + soln[sq2]-1];
+                } while (t0 != t);
+                if (!ok)
+                    continue;
+                for (k = 0; k < 3*cr+2; k++)
+                    if (acc[k])
+                        break;
+                if (k == 3*cr+2)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void gen_fill(struct solo_gen *g, digit *grid2, candset *houses,
+                     int xy, int *nfilled)
+{
+    int h[5], nh, k;
+
+    grid2[xy] = g->soln[xy];
+    nh = gen_houses(g, xy, h);
+    for (k = 0; k < nh; k++)
+        houses[h[k]] |= CANDBIT(g->soln[xy]-1);
+    g->filled[(*nfilled)++] = xy;
+}
+
+/*
+ * Cheap sufficient test for the clue-removal loop. The last accepted
+ * grid is uniquely soluble, so if the squares cleared from it are
+ * forced straight back in by naked and hidden singles, the new grid
+ * is too. Propagation starts from the clue digits kept in g->houses
+ * and stops as soon as every cleared square has been filled, which
+ * for most removals is on the first pass. grid2 is left as it was
+ * found.
+ */
+static bool gen_removal_forced(struct solo_gen *g, digit *grid2,
+                               const int *coords, int ncoords)
+{
+    int cr = g->params->c * g->params->r, area = cr*cr;
+    int nhouses = 3*cr + (g->params->xtype ? 2 : 0);
+    candset *houses = g->hscratch;
+    int nfilled = 0, left = 0;
+    int h[5], nh;
+    int i, j, k, xy;
+    bool progress;
+
+    memcpy(houses, g->houses, (3*cr+2) * sizeof(candset));
+    for (j = 0; j < ncoords; j++) {
+        candset bit;
+
+        xy = coords[2*j+1]*cr+coords[2*j];
+        bit = CANDBIT(g->soln[xy]-1);
+        if (!(houses[xy / cr] & bit))
+            continue;                  /* symmetric duplicate */
+        nh = gen_houses(g, xy, h);
+        for (k = 0; k < nh; k++)
+            houses[h[k]] &= ~bit;
+        left++;
+    }
+
+    do {
+        progress = false;
+
+        /* Naked singles. */
+        for (xy = 0; xy < area && left > 0; xy++) {
+            if (grid2[xy])
+                continue;
+            if ((CANDALL(cr) & ~gen_seen(g, houses, xy)) ==
+                CANDBIT(g->soln[xy]-1)) {
+                gen_fill(g, grid2, houses, xy, &nfilled);
+                if (g->grid[xy])
+                    left--;
+                progress = true;
+            }
+        }
+
+        /* Hidden singles. */
+        for (k = 0; k < nhouses && left > 0; k++) {
+            candset once = 0, twice = 0, cand;
+
+            for (i = 0; i < cr; i++) {
+                xy = gen_house_square(g, k, i);
+                if (grid2[xy])
+                    continue;
+                cand = CANDALL(cr) & ~gen_seen(g, houses, xy);
+                twice |= once & cand;
+                once |= cand;
+            }
+            once &= ~twice;
+            for (i = 0; once && i < cr; i++) {
+                xy = gen_house_square(g, k, i);
+                if (!grid2[xy] && (once & CANDBIT(g->soln[xy]-1))) {
+                    gen_fill(g, grid2, houses, xy, &nfilled);
+                    if (g->grid[xy])
+                        left--;
+                    progress = true;
+                }
+            }
+        }
+    } while (progress && left > 0);
+
+    for (i = 0; i < nfilled; i++)
+        grid2[g->filled[i]] = 0;
+    return left == 0;
+}
+
+/*
+ * Make one attempt at generating a puzzle, returning true if the
+ * result is of the required difficulty. On success the puzzle is
+ * left in g->grid, g->blocks, g->kgrid and g->kblocks, and its
+ * solution in g->aux.
+ */
+static bool solo_gen_attempt(struct solo_gen *g, random_state *rs)
+{
+    const game_params *params = g->params;
+    int c = params->c, r = params->r, cr = c*r;
+    int area = cr*cr;
+    struct block_structure *blocks = g->blocks;
+    digit *grid = g->grid, *grid2 = g->grid2, *kgrid = g->kgrid;
+    struct xy *locs = g->locs;
+    struct dlx *dlx = g->dlx;
     int nlocs;
-    char *desc;
     int coords[16], ncoords;
     int x, y, i, j;
     struct difficulty dlev;
 
-    precompute_sum_bits();
-
     /*
      * Adjust the maximum difficulty level to be consistent with
      * the puzzle size: all 2x2 puzzles appear to be Trivial
@@ -3683,224 +5043,458 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     if (c == 2 && r == 2)
         dlev.maxdiff = DIFF_BLOCK;
 
-    grid = snewn(area, digit);
-    locs = snewn(area, struct xy);
-    grid2 = snewn(area, digit);
-
-    blocks = alloc_block_structure (c, r, area, cr, cr);
-
-    kblocks = NULL;
-    kgrid = (params->killer) ? snewn(area, digit) : NULL;
-
-#ifdef STANDALONE_SOLVER
-    assert(!"This should never happen, so we don't need to create blocknames");
-#endif
-
     /*
-     * Loop until we get a grid of the required difficulty. This is
-     * nasty, but it seems to be unpleasantly hard to generate
-     * difficult grids otherwise.
+     * Generate a random solved state, starting by
+     * constructing the block structure.
      */
-    while (1) {
-        /*
-         * Generate a random solved state, starting by
-         * constructing the block structure.
-         */
-        if (r == 1) {                       /* jigsaw mode */
-            int *dsf = divvy_rectangle(cr, cr, cr, rs);
+    if (r == 1) {                       /* jigsaw mode */
+        int *dsf = divvy_rectangle(cr, cr, cr, rs);
 
-            dsf_to_blocks (dsf, blocks, cr, cr);
+        dsf_to_blocks (dsf, blocks, cr, cr);
 
-            sfree(dsf);
-        } else {                       /* basic Sudoku mode */
-            for (y = 0; y < cr; y++)
-                for (x = 0; x < cr; x++)
-                    blocks->whichblock[y*cr+x] = (y/c) * c + (x/r);
-        }
-        make_blocks_from_whichblock(blocks);
+        sfree(dsf);
+    } else {                       /* basic Sudoku mode */
+        for (y = 0; y < cr; y++)
+            for (x = 0; x < cr; x++)
+                blocks->whichblock[y*cr+x] = (y/c) * c + (x/r);
+    }
+    make_blocks_from_whichblock(blocks);
 
-        if (params->manual) {
-            memset(grid, 0, cr*cr);
-            break;
-        }
+    if (params->manual) {
+        memset(grid, 0, cr*cr);
+        return true;
+    }
 
-        if (params->killer) {
-            if (kblocks) free_block_structure(kblocks);
-            kblocks = gen_killer_cages(cr, rs, params->kdiff > DIFF_KSINGLE);
-        }
+    if (!g->sctx)
+        g->sctx = solver_ctx_new(cr, blocks, params->xtype);
+    else
+        solver_ctx_set_blocks(g->sctx, blocks);
 
-        if (!gridgen(cr, blocks, kblocks, params->xtype, grid, rs, area*area))
-            continue;
-        assert(check_valid(cr, blocks, kblocks, NULL, params->xtype, grid));
+    if (params->killer) {
+        if (g->kblocks) free_block_structure(g->kblocks);
+        g->kblocks = gen_killer_cages(cr, rs, params->kdiff > DIFF_KSINGLE);
+    }
+
+    /*
+     * With its look-ahead, gridgen either fills a large grid almost
+     * straight away or gets stuck for a very long time, so for those
+     * orders it's much quicker to give up early and start afresh.
+     */
+    if (!gridgen(cr, blocks, g->kblocks, params->xtype, grid, rs,
+                 cr >= GRIDGEN_LOOKAHEAD_ORDER ? 2*area : area*area))
+        return false;
+    assert(check_valid(cr, blocks, g->kblocks, NULL, params->xtype, grid));
 
+    /*
+     * Save the solved grid in aux.
+     */
+    {
         /*
-         * Save the solved grid in aux.
+         * We might already have written aux on the last attempt,
+         * in which case we should free the old aux before
+         * overwriting it with the new one.
          */
-        {
-            /*
-             * We might already have written *aux the last time we
-             * went round this loop, in which case we should free
-             * the old aux before overwriting it with the new one.
-             */
-            if (*aux) {
-                sfree(*aux);
-            }
-
-            *aux = encode_solve_move(cr, grid);
+        if (g->aux) {
+            sfree(g->aux);
         }
 
+        g->aux = encode_solve_move(cr, grid);
+    }
+
+    /*
+     * Now we have a solved grid. For normal puzzles, we start removing
+     * things from it while preserving solubility.  Killer puzzles are
+     * different: we just pass the empty grid to the solver, and use
+     * the puzzle if it comes back solved.
+     */
+
+    if (params->killer) {
+        struct block_structure *good_cages = NULL;
+        struct block_structure *last_cages = NULL;
+        struct cage_pair *pairs = g->cpairs, tried = { -1, -1 };
+        int npairs, ngood = 0, nlast = 0;
+        int ntries = 0;
         /*
-         * Now we have a solved grid. For normal puzzles, we start removing
-         * things from it while preserving solubility.  Killer puzzles are
-         * different: we just pass the empty grid to the solver, and use
-         * the puzzle if it comes back solved.
+         * Which saved layout, if any, the current one is a single
+         * merge away from.
          */
+        enum { FROM_NONE, FROM_GOOD, FROM_LAST } from = FROM_NONE;
 
-        if (params->killer) {
-            struct block_structure *good_cages = NULL;
-            struct block_structure *last_cages = NULL;
-            int ntries = 0;
-
-            memcpy(grid2, grid, area);
+        memcpy(grid2, grid, area);
+        npairs = find_cage_pairs(g->kblocks, cr, pairs, g->cmark);
 
-            for (;;) {
-                compute_kclues(kblocks, kgrid, grid2, area);
+        for (;;) {
+            compute_kclues(g->kblocks, kgrid, grid2, area);
 
-                memset(grid, 0, area * sizeof *grid);
-                solver(cr, blocks, kblocks, params->xtype, grid, kgrid, &dlev);
-                if (dlev.diff == dlev.maxdiff && dlev.kdiff == dlev.maxkdiff) {
-                    /*
-                     * We have one that matches our difficulty.  Store it for
-                     * later, but keep going.
-                     */
+            memset(grid, 0, area * sizeof *grid);
+            /*
+             * When the solver is allowed to recurse, it can take
+             * a long time to discover that a cage layout is
+             * ambiguous; the exact-cover counter finds out much
+             * sooner, and we only grade layouts that pass.
+             */
+            if (dlev.maxdiff >= DIFF_RECURSIVE &&
+                dlx_count_solutions(dlx, blocks, g->kblocks, params->xtype,
+                                    grid, kgrid, 2, NULL) != 1)
+                dlev.diff = DIFF_AMBIGUOUS;
+            else
+                solver_ctx_solve(g->sctx, g->kblocks, grid, kgrid, &dlev);
+            if (dlev.maxdiff >= DIFF_RECURSIVE &&
+                dlev.diff == DIFF_RECURSIVE) {
+                /*
+                 * Once a layout needs recursion, merging further
+                 * can't make it grade any differently; it only makes
+                 * every uniqueness check slower, until one finds the
+                 * layout ambiguous. So stop here, keeping this
+                 * layout only if its cage deductions are right.
+                 */
+                if (dlev.kdiff == dlev.maxkdiff) {
                     if (good_cages)
                         free_block_structure(good_cages);
-                    ntries = 0;
-                    good_cages = dup_block_structure(kblocks);
-                    if (!merge_some_cages(kblocks, cr, area, grid2, rs))
-                        break;
-                } else if (dlev.diff > dlev.maxdiff || dlev.kdiff > dlev.maxkdiff) {
-                    /*
-                     * Give up after too many tries and either use the good one we
-                     * found, or generate a new grid.
-                     */
-                    if (++ntries > 50)
-                        break;
-                    /*
-                     * The difficulty level got too high.  If we have a good
-                     * one, use it, otherwise go back to the last one that
-                     * was at a lower difficulty and restart the process from
-                     * there.
-                     */
-                    if (good_cages != NULL) {
-                        free_block_structure(kblocks);
-                        kblocks = dup_block_structure(good_cages);
-                        if (!merge_some_cages(kblocks, cr, area, grid2, rs))
-                            break;
-                    } else {
-                        if (last_cages == NULL)
-                            break;
-                        free_block_structure(kblocks);
-                        kblocks = last_cages;
-                        last_cages = NULL;
-                    }
+                    good_cages = dup_block_structure(g->kblocks);
+                }
+                break;
+            } else if (dlev.diff == dlev.maxdiff &&
+                       dlev.kdiff == dlev.maxkdiff) {
+                /*
+                 * We have one that matches our difficulty.  Store it for
+                 * later, but keep going.
+                 */
+                if (good_cages)
+                    free_block_structure(good_cages);
+                ntries = 0;
+                good_cages = dup_block_structure(g->kblocks);
+                memcpy(g->good_cpairs, pairs, npairs * sizeof *pairs);
+                ngood = npairs;
+                from = FROM_GOOD;
+            } else if (dlev.diff > dlev.maxdiff || dlev.kdiff > dlev.maxkdiff) {
+                struct cage_pair *saved;
+                int *nsaved, i;
+                bool adjacent;
+
+                /*
+                 * Give up after too many tries and either use the good one we
+                 * found, or generate a new grid.
+                 */
+                if (++ntries > 50)
+                    break;
+                /*
+                 * The difficulty level got too high.  If we have a good
+                 * one, use it, otherwise go back to the last one that
+                 * was at a lower difficulty and restart the process from
+                 * there. Either way we already know how that layout
+                 * grades, so rather than solve it again we go straight
+                 * on to another merge. If this layout was a single merge
+                 * away from it, that merge is no use and is struck off
+                 * its list.
+                 */
+                if (good_cages != NULL) {
+                    free_block_structure(g->kblocks);
+                    g->kblocks = dup_block_structure(good_cages);
+                    saved = g->good_cpairs;
+                    nsaved = &ngood;
+                    adjacent = (from == FROM_GOOD);
+                    from = FROM_GOOD;
                 } else {
-                    if (last_cages)
-                        free_block_structure(last_cages);
-                    last_cages = dup_block_structure(kblocks);
-                    if (!merge_some_cages(kblocks, cr, area, grid2, rs))
+                    if (last_cages == NULL)
                         break;
+                    free_block_structure(g->kblocks);
+                    g->kblocks = dup_block_structure(last_cages);
+                    saved = g->last_cpairs;
+                    nsaved = &nlast;
+                    adjacent = (from == FROM_LAST);
+                    from = FROM_LAST;
+                }
+
+                if (adjacent) {
+                    for (i = 0; i < *nsaved; i++)
+                        if (saved[i].b1 == tried.b1 &&
+                            saved[i].b2 == tried.b2) {
+                            saved[i] = saved[--*nsaved];
+                            break;
+                        }
                 }
+                memcpy(pairs, saved, *nsaved * sizeof *pairs);
+                npairs = *nsaved;
+            } else {
+                if (last_cages)
+                    free_block_structure(last_cages);
+                last_cages = dup_block_structure(g->kblocks);
+                memcpy(g->last_cpairs, pairs, npairs * sizeof *pairs);
+                nlast = npairs;
+                from = FROM_LAST;
             }
-            if (last_cages)
-                free_block_structure(last_cages);
-            if (good_cages != NULL) {
-                free_block_structure(kblocks);
-                kblocks = good_cages;
-                compute_kclues(kblocks, kgrid, grid2, area);
-                memset(grid, 0, area * sizeof *grid);
+
+            if (!merge_some_cages(g->kblocks, grid2, pairs, &npairs,
+                                  g->cmark, &tried, rs))
                 break;
+        }
+        if (last_cages)
+            free_block_structure(last_cages);
+        if (good_cages != NULL) {
+            free_block_structure(g->kblocks);
+            g->kblocks = good_cages;
+            compute_kclues(g->kblocks, kgrid, grid2, area);
+            memset(grid, 0, area * sizeof *grid);
+            return true;
+        }
+        return false;
+    }
+
+    /*
+     * Find the set of equivalence classes of squares permitted
+     * by the selected symmetry. We do this by enumerating all
+     * the grid squares which have no symmetric companion
+     * sorting lower than themselves.
+     */
+    nlocs = 0;
+    for (y = 0; y < cr; y++)
+        for (x = 0; x < cr; x++) {
+            int i = y*cr+x;
+            int j;
+
+            ncoords = symmetries(params, x, y, coords, params->symm);
+            for (j = 0; j < ncoords; j++)
+                if (coords[2*j+1]*cr+coords[2*j] < i)
+                    break;
+            if (j == ncoords) {
+                locs[nlocs].x = x;
+                locs[nlocs].y = y;
+                nlocs++;
             }
-            continue;
         }
 
+    /*
+     * Now shuffle that list.
+     */
+    shuffle(locs, nlocs, sizeof(*locs), rs);
+
+    memcpy(g->soln, grid, area);
+    for (i = 0; i < 3*cr+2; i++)
+        g->houses[i] = CANDALL(cr);
+    for (y = 0; y < cr; y++)
+        for (x = 0; x < cr; x++) {
+            g->linepos[y*cr + grid[y*cr+x]-1] = x;
+            g->linepos[(cr+x)*cr + grid[y*cr+x]-1] = y;
+        }
+
+    /*
+     * Now loop over the shuffled list and, for each element,
+     * see whether removing that element (and its reflections)
+     * from the grid will still leave the grid soluble.
+     */
+    for (i = 0; i < nlocs; i++) {
+        x = locs[i].x;
+        y = locs[i].y;
+
+        memcpy(grid2, grid, area);
+        ncoords = symmetries(params, x, y, coords, params->symm);
+        for (j = 0; j < ncoords; j++)
+            grid2[coords[2*j+1]*cr+coords[2*j]] = 0;
+
         /*
-         * Find the set of equivalence classes of squares permitted
-         * by the selected symmetry. We do this by enumerating all
-         * the grid squares which have no symmetric companion
-         * sorting lower than themselves.
+         * Only a uniquely soluble grid will do. A swappable
+         * cycle of empty squares rules that out at once, and
+         * if the cleared squares are forced straight back by
+         * singles it is assured; otherwise the exact-cover
+         * counter is much the quickest way to find out. For
+         * Unreasonable puzzles, where the solver may recurse as
+         * much as it likes, that is the whole question; otherwise
+         * we still need the solver to tell us whether the
+         * deductions required are within the difficulty limit.
+         *
+         * A solver that gets there by deduction alone has shown
+         * the solution is unique anyway, so below Unreasonable
+         * the counter only saves time by turning ambiguous grids
+         * away before the solver sees them, and solo_gen_init()
+         * leaves it out where it wouldn't.
          */
-        nlocs = 0;
-        for (y = 0; y < cr; y++)
-            for (x = 0; x < cr; x++) {
-                int i = y*cr+x;
-                int j;
+        if (gen_removal_ambiguous(g, grid2, coords, ncoords))
+            continue;
+        if (!gen_removal_forced(g, grid2, coords, ncoords) && dlx &&
+            dlx_count_solutions(dlx, blocks, g->kblocks, params->xtype,
+                                grid2, kgrid, 2, NULL) != 1)
+            continue;
+        if (dlev.maxdiff < DIFF_RECURSIVE) {
+            solver_ctx_solve(g->sctx, g->kblocks, grid2, kgrid, &dlev);
+            if (dlev.diff > dlev.maxdiff ||
+                (params->killer && dlev.kdiff > dlev.maxkdiff))
+                continue;
+        }
+        for (j = 0; j < ncoords; j++) {
+            int xy = coords[2*j+1]*cr+coords[2*j], h[5], nh, k;
 
-                ncoords = symmetries(params, x, y, coords, params->symm);
-                for (j = 0; j < ncoords; j++)
-                    if (coords[2*j+1]*cr+coords[2*j] < i)
-                        break;
-                if (j == ncoords) {
-                    locs[nlocs].x = x;
-                    locs[nlocs].y = y;
-                    nlocs++;
-                }
-            }
+            grid[xy] = 0;
+            nh = gen_houses(g, xy, h);
+            for (k = 0; k < nh; k++)
+                g->houses[h[k]] &= ~CANDBIT(g->soln[xy]-1);
+        }
+    }
 
-        /*
-         * Now shuffle that list.
-         */
-        shuffle(locs, nlocs, sizeof(*locs), rs);
+    memcpy(grid2, grid, area);
 
-        /*
-         * Now loop over the shuffled list and, for each element,
-         * see whether removing that element (and its reflections)
-         * from the grid will still leave the grid soluble.
-         */
-        for (i = 0; i < nlocs; i++) {
-            x = locs[i].x;
-            y = locs[i].y;
+    solver_ctx_solve(g->sctx, g->kblocks, grid2, kgrid, &dlev);
+    return (dlev.diff == dlev.maxdiff &&
+            (!params->killer || dlev.kdiff == dlev.maxkdiff));
+}
 
-            memcpy(grid2, grid, area);
-            ncoords = symmetries(params, x, y, coords, params->symm);
-            for (j = 0; j < ncoords; j++)
-                grid2[coords[2*j+1]*cr+coords[2*j]] = 0;
+#ifdef USE_PTHREADS
+/*
+ * Multi-threaded generation, for batch use. Nearly every attempt
+ * new_game_desc() makes is thrown away, so we run attempts side by
+ * side on worker threads. To keep the output independent of the
+ * number of threads and of how they happen to be scheduled, attempt
+ * k draws its random numbers from its own substream, seeded from
+ * a single draw on the caller's random_state together with k, and
+ * the puzzle returned is that of the lowest-numbered attempt to
+ * succeed. Attempts are handed out in order and none is started
+ * beyond the best success so far, so by the time every worker has
+ * stopped, all the attempts before the winner are known to have
+ * failed.
+ *
+ * solo_gen_threads is zero for the ordinary sequential generator.
+ * Any positive value selects the substream scheme, so one thread
+ * generates the same puzzles as any other number of them.
+ *
+ * The workers share no solver state. The one global the solver
+ * writes, solver_recurse_depth, is only touched when showing
+ * working, which new_game_desc() rules out.
+ */
+static int solo_gen_threads = 0;
 
-            solver(cr, blocks, kblocks, params->xtype, grid2, kgrid, &dlev);
-            if (dlev.diff <= dlev.maxdiff &&
-                (!params->killer || dlev.kdiff <= dlev.maxkdiff)) {
-                for (j = 0; j < ncoords; j++)
-                    grid[coords[2*j+1]*cr+coords[2*j]] = 0;
-            }
+struct solo_genworker {
+    struct solo_genpool *pool;
+    pthread_t thread;
+    struct solo_gen gen;
+};
+
+struct solo_genpool {
+    char seed[40];
+    pthread_mutex_t lock;
+    int next;                          /* next attempt to hand out */
+    int found;                         /* best success so far */
+    char *desc, *aux;                  /* and its results */
+};
+
+static void *genworker_solo(void *ctx)
+{
+    struct solo_genworker *wk = (struct solo_genworker *)ctx;
+    struct solo_genpool *pool = wk->pool;
+    struct solo_gen *g = &wk->gen;
+    char seed[80];
+    random_state *rs;
+    char *desc;
+    bool ok;
+    int k;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->next < pool->found) {
+        k = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+
+        sprintf(seed, "%s:%d", pool->seed, k);
+        rs = random_new(seed, strlen(seed));
+        ok = solo_gen_attempt(g, rs);
+        random_free(rs);
+        desc = ok ? encode_puzzle_desc(g->params, g->grid, g->blocks,
+                                       g->kgrid, g->kblocks) : NULL;
+
+        pthread_mutex_lock(&pool->lock);
+        if (ok && k < pool->found) {
+            sfree(pool->desc);
+            sfree(pool->aux);
+            pool->found = k;
+            pool->desc = desc;
+            pool->aux = g->aux;
+            g->aux = NULL;
+        } else {
+            sfree(desc);
         }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
 
-        memcpy(grid2, grid, area);
+static char *new_game_desc_parallel(const game_params *params,
+                                    random_state *rs, char **aux)
+{
+    struct solo_genpool pool;
+    struct solo_genworker *workers;
+    unsigned long seed0, seed1;
+    int nthreads = solo_gen_threads, i;
+
+    seed0 = random_bits(rs, 32);
+    seed1 = random_bits(rs, 32);
+    sprintf(pool.seed, "%08lx%08lx", seed0, seed1);
+    pool.next = 0;
+    pool.found = INT_MAX;
+    pool.desc = pool.aux = NULL;
+    pthread_mutex_init(&pool.lock, NULL);
+
+    workers = snewn(nthreads, struct solo_genworker);
+    for (i = 0; i < nthreads; i++) {
+        workers[i].pool = &pool;
+        solo_gen_init(&workers[i].gen, params);
+        pthread_create(&workers[i].thread, NULL, genworker_solo, &workers[i]);
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        solo_gen_free(&workers[i].gen);
+    }
+    sfree(workers);
+    pthread_mutex_destroy(&pool.lock);
 
-        solver(cr, blocks, kblocks, params->xtype, grid2, kgrid, &dlev);
-        if (dlev.diff == dlev.maxdiff &&
-            (!params->killer || dlev.kdiff == dlev.maxkdiff))
-            break;                       /* found one! */
+    if (pool.aux) {
+        if (*aux)
+            sfree(*aux);
+        *aux = pool.aux;
     }
+    return pool.desc;
+}
+#endif
+
+static char *new_game_desc(const game_params *params, random_state *rs,
+                           char **aux, bool interactive)
+{
+    struct solo_gen g;
+    char *desc;
+
+    precompute_sum_bits();
+
+#ifdef STANDALONE_SOLVER
+    /* We don't create blocknames, so the solver mustn't print. */
+    assert(!solver_show_working);
+#endif
+
+#ifdef USE_PTHREADS
+    if (solo_gen_threads > 0)
+        return new_game_desc_parallel(params, rs, aux);
+#endif
 
-    sfree(grid2);
-    sfree(locs);
+    /*
+     * Loop until we get a grid of the required difficulty. This is
+     * nasty, but it seems to be unpleasantly hard to generate
+     * difficult grids otherwise.
+     */
+    solo_gen_init(&g, params);
+    while (!solo_gen_attempt(&g, rs));
 
     /*
      * Now we have the grid as it will be presented to the user.
      * Encode it in a game desc.
      */
-    desc = encode_puzzle_desc(params, grid, blocks, kgrid, kblocks);
+    desc = encode_puzzle_desc(params, g.grid, g.blocks, g.kgrid, g.kblocks);
 
-    sfree(grid);
-    free_block_structure(blocks);
-    if (params->killer) {
-        free_block_structure(kblocks);
-        sfree(kgrid);
+    if (g.aux) {
+        if (*aux)
+            sfree(*aux);
+        *aux = g.aux;
+        g.aux = NULL;
     }
+    solo_gen_free(&g);
 
     return desc;
 }
-
 static const char *spec_to_grid(const char *desc, digit *grid, int area)
 {
     int i = 0;
@@ -4459,10 +6053,8 @@ static char *grid_text_format(int cr, struct block_structure *blocks,
                     ch = '_';
                 else
                     ch = '.';
-            } else if (d <= 9) {
-                ch = '0' + d;
             } else {
-                ch = 'a' + d-10;
+                ch = digit_char(d);
             }
 
             *p++ = ch;
@@ -4659,8 +6251,22 @@ struct game_drawstate {
     digit *grid;
     unsigned char *pencil;
     unsigned char *hl;
-    /* This is scratch space used within a single call to game_redraw. */
+    /*
+     * Count of each digit in every region in which digits may not be
+     * duplicated, as of ds->grid. It is built in full on the first
+     * redraw and from then on adjusted only for the squares whose
+     * digit changed.
+     */
     int nregions, *entered_items;
+    /*
+     * Squares to recompute in the current call to game_redraw, and
+     * the highlight inputs which affect every square at once, as of
+     * the last redraw.
+     */
+    int *dirty, ndirty;
+    bool *isdirty;
+    int hx, hy, hcursor, hhint;
+    bool flashing, entry;
 };
 
 static char *interpret_move(const game_state *state, game_ui *ui,
@@ -4668,7 +6274,7 @@ static char *interpret_move(const game_state *state, game_ui *ui,
                             int x, int y, int button)
 {
     int cr = state->cr;
-    int tx, ty;
+    int tx, ty, n;
     char buf[80];
     bool fixed_entry = state->manual && !state->fixed;
 
@@ -4752,16 +6358,9 @@ static char *interpret_move(const game_state *state, game_ui *ui,
         return UI_UPDATE;
     }
 
+    n = char_digit(button, cr);
     if (ui->hshow &&
-        ((button >= '0' && button <= '9' && button - '0' <= cr) ||
-         (button >= 'a' && button <= 'z' && button - 'a' + 10 <= cr) ||
-         (button >= 'A' && button <= 'Z' && button - 'A' + 10 <= cr) ||
-         button == CURSOR_SELECT2 || button == '\b')) {
-        int n = button - '0';
-        if (button >= 'A' && button <= 'Z')
-            n = button - 'A' + 10;
-        if (button >= 'a' && button <= 'z')
-            n = button - 'a' + 10;
+        (n >= 0 || button == CURSOR_SELECT2 || button == '\b')) {
         if (button == CURSOR_SELECT2 || button == '\b')
             n = 0;
         ui->hhint = 0;
@@ -4787,17 +6386,7 @@ static char *interpret_move(const game_state *state, game_ui *ui,
 
         return dupstr(buf);
     }
-    if (!ui->hshow &&
-       ((button >= '0' && button <= '9' && button - '0' <= cr) ||
-        (button >= 'a' && button <= 'z' && button - 'a' + 10 <= cr) ||
-        (button >= 'A' && button <= 'Z' && button - 'A' + 10 <= cr))) {
-
-        int n = button - '0';
-        if (button >= 'A' && button <= 'Z')
-            n = button - 'A' + 10;
-        if (button >= 'a' && button <= 'z')
-            n = button - 'a' + 10;
-
+    if (!ui->hshow && n >= 0) {
         if (ui->hhint == n) ui->hhint = 0;
         else ui->hhint = n;
         return UI_UPDATE;
@@ -4808,41 +6397,65 @@ static char *interpret_move(const game_state *state, game_ui *ui,
     return NULL;
 }
 
-static bool check_hint(const game_state *state, int x, int y, int n) {
-    int cr = state->cr;
-    int cx,cy,i;
-    bool check;
-
-    for (cx = 0, cy = y, check = false; cx < cr;cx++)
-        if (state->grid[cy*cr+cx] == n) 
-            { check = true; break; }
-    
-    if (!check) for (cx = x, cy = 0;    cy < cr;cy++)
-        if (state->grid[cy*cr+cx] == n) 
-            { check = true; break; }
-
-    if (!check) for (i = 0;i<cr;i++)
-        if (state->grid[state->blocks->blocks[state->blocks->whichblock[y*cr+x]][i]] == n) 
-            { check = true; break; }
+/*
+ * Work out which digits each square can see already: bit n-1 of
+ * used[xy] is set if digit n is in the row, column or block of
+ * square xy, on a diagonal through it in an X puzzle, or in its
+ * killer cage. We collect a digit mask for each of those once and
+ * OR together the ones each square belongs to, rather than scanning
+ * all of them for every digit of every square.
+ */
+static void hint_masks(const game_state *state, candset *used)
+{
+    int cr = state->cr, area = cr*cr;
+    candset *rows, *cols, *blks, *cages = NULL;
+    candset diags[2] = { 0, 0 };
+    int xy;
+
+    rows = snewn(cr, candset);
+    cols = snewn(cr, candset);
+    blks = snewn(cr, candset);
+    memset(rows, 0, cr * sizeof(candset));
+    memset(cols, 0, cr * sizeof(candset));
+    memset(blks, 0, cr * sizeof(candset));
+    if (state->kblocks) {
+        cages = snewn(state->kblocks->nr_blocks, candset);
+        memset(cages, 0, state->kblocks->nr_blocks * sizeof(candset));
+    }
 
-    if (state->xtype) {
-        if (!check && ondiag0(y*cr+x)) 
-            for (i=0;i<cr;i++)
-                if (state->grid[diag0(i)] == n) {check = true; break; }
+    for (xy = 0; xy < area; xy++) {
+        int n = state->grid[xy];
+        candset bit;
 
-        if (!check && ondiag1(y*cr+x)) 
-            for (i=0;i<cr;i++)
-                if (state->grid[diag1(i)] == n) {check = true; break; }
+        if (!n)
+            continue;
+        bit = CANDBIT(n-1);
+        rows[xy / cr] |= bit;
+        cols[xy % cr] |= bit;
+        blks[state->blocks->whichblock[xy]] |= bit;
+        if (state->xtype && ondiag0(xy))
+            diags[0] |= bit;
+        if (state->xtype && ondiag1(xy))
+            diags[1] |= bit;
+        if (cages)
+            cages[state->kblocks->whichblock[xy]] |= bit;
     }
 
-    if (state->kblocks) {
-        if (!check) 
-            for (i=0;i<state->kblocks->nr_squares[state->kblocks->whichblock[y*cr+x]];i++)
-                if (state->grid[state->kblocks->blocks[state->kblocks->whichblock[y*cr+x]][i]] == n) 
-                    {check = true; break; }
+    for (xy = 0; xy < area; xy++) {
+        used[xy] = rows[xy / cr] | cols[xy % cr] |
+            blks[state->blocks->whichblock[xy]];
+        if (state->xtype && ondiag0(xy))
+            used[xy] |= diags[0];
+        if (state->xtype && ondiag1(xy))
+            used[xy] |= diags[1];
+        if (cages)
+            used[xy] |= cages[state->kblocks->whichblock[xy]];
     }
 
-    return check;
+    sfree(cages);
+    sfree(blks);
+    sfree(cols);
+    sfree(rows);
 }
 
 static game_state *execute_move(const game_state *from, const char *move)
@@ -4852,19 +6465,23 @@ static game_state *execute_move(const game_state *from, const char *move)
     int x, y, n;
 
     if (move[0] == '+' || move[0] == '-') {
+        candset *used = snewn(cr*cr, candset);
+
+        hint_masks(from, used);
         ret = dup_game(from);
         for (x=0;x<cr;x++)
         for (y=0;y<cr;y++) {
             if (ret->grid[y*cr+x] == 0) 
                 for (n=1;n<=cr;n++) {
-                    if (move[0] == '+' && !check_hint(from,x,y,n)) 
+                    bool seen = used[y*cr+x] & CANDBIT(n-1);
+                    if (move[0] == '+' && !seen)
                         ret->pencil[(y*cr+x) * cr + (n-1)] = true;
                     else if (move[0] == '-' && 
-                             ret->pencil[(y*cr+x) * cr + (n-1)] && 
-                             check_hint(from,x,y,n)) 
+                             ret->pencil[(y*cr+x) * cr + (n-1)] && seen)
                         ret->pencil[(y*cr+x) * cr + (n-1)] = false;
                 }
             }
+        sfree(used);
         return ret;
     }
     else if (move[0] == 'Y') {
@@ -5045,6 +6662,13 @@ static game_drawstate *game_new_drawstate(drawing *dr, const game_state *state)
     if (state->kblocks)
         ds->nregions += state->kblocks->nr_blocks;
     ds->entered_items = snewn(cr * ds->nregions, int);
+    ds->dirty = snewn(cr*cr, int);
+    ds->ndirty = 0;
+    ds->isdirty = snewn(cr*cr, bool);
+    memset(ds->isdirty, 0, cr*cr * sizeof(bool));
+    ds->hx = ds->hy = -1;
+    ds->hcursor = ds->hhint = 0;
+    ds->flashing = ds->entry = false;
     ds->tilesize = 0;                  /* not decided yet */
     return ds;
 }
@@ -5055,6 +6679,8 @@ static void game_free_drawstate(drawing *dr, game_drawstate *ds)
     sfree(ds->pencil);
     sfree(ds->grid);
     sfree(ds->entered_items);
+    sfree(ds->isdirty);
+    sfree(ds->dirty);
     sfree(ds);
 }
 
@@ -5218,9 +6844,7 @@ static void draw_number(drawing *dr, game_drawstate *ds,
     /* new number needs drawing? */
     if (state->grid[y*cr+x]) {
         str[1] = '\0';
-        str[0] = state->grid[y*cr+x] + '0';
-        if (str[0] > '9')
-            str[0] += 'a' - ('9'+1);
+        str[0] = digit_char(state->grid[y*cr+x]);
         draw_text(dr, tx + TILE_SIZE/2, ty + TILE_SIZE/2,
                   FONT_VARIABLE, TILE_SIZE/2, ALIGN_VCENTRE | ALIGN_HCENTRE,
                   state->immutable[y*cr+x] ? COL_CLUE : (hl & 16) ? COL_ERROR : COL_USER, str);
@@ -5323,9 +6947,7 @@ static void draw_number(drawing *dr, game_drawstate *ds,
                     int dx = j % pw, dy = j / pw;
 
                     str[1] = '\0';
-                    str[0] = i + '1';
-                    if (str[0] > '9')
-                        str[0] += 'a' - ('9'+1);
+                    str[0] = digit_char(i+1);
                     draw_text(dr, pl + fontsize * (2*dx+1) / 2,
                               pt + fontsize * (2*dy+1) / 2,
                               FONT_VARIABLE, fontsize,
@@ -5344,13 +6966,147 @@ static void draw_number(drawing *dr, game_drawstate *ds,
     ds->hl[y*cr+x] = hl;
 }
 
+static void mark_dirty(game_drawstate *ds, int xy)
+{
+    if (!ds->isdirty[xy]) {
+        ds->isdirty[xy] = true;
+        ds->dirty[ds->ndirty++] = xy;
+    }
+}
+
+/*
+ * Mark every square of a region which holds digit d, after the
+ * number of d's in that region has crossed between one and two.
+ * Regions are numbered as in ds->entered_items.
+ */
+static void mark_region_digit(game_drawstate *ds, const game_state *state,
+                              int region, digit d)
+{
+    int cr = state->cr;
+    int i, xy;
+
+    if (region < cr) {
+        for (i = 0; i < cr; i++)
+            if (state->grid[i*cr+region] == d)
+                mark_dirty(ds, i*cr+region);
+    } else if (region < 2*cr) {
+        for (i = 0; i < cr; i++)
+            if (state->grid[(region-cr)*cr+i] == d)
+                mark_dirty(ds, (region-cr)*cr+i);
+    } else if (region < 3*cr) {
+        for (i = 0; i < state->blocks->nr_squares[region-2*cr]; i++) {
+            xy = state->blocks->blocks[region-2*cr][i];
+            if (state->grid[xy] == d)
+                mark_dirty(ds, xy);
+        }
+    } else if (region < 3*cr+2) {
+        for (i = 0; i < cr; i++) {
+            xy = (region == 3*cr ? i*cr+i : i*cr+(cr-1-i));
+            if (state->grid[xy] == d)
+                mark_dirty(ds, xy);
+        }
+    } else {
+        int kbox = region - (3*cr+2);
+        for (i = 0; i < state->kblocks->nr_squares[kbox]; i++) {
+            xy = state->kblocks->blocks[kbox][i];
+            if (state->grid[xy] == d)
+                mark_dirty(ds, xy);
+        }
+    }
+}
+
+/*
+ * Add delta to the count of digit d in every region containing xy,
+ * marking the other holders of d wherever that count crosses between
+ * one and two.
+ */
+static void count_digit(game_drawstate *ds, const game_state *state,
+                        int xy, digit d, int delta)
+{
+    int cr = state->cr;
+    int regions[5], nr = 0, i;
+
+    regions[nr++] = xy % cr;
+    regions[nr++] = xy / cr + cr;
+    regions[nr++] = state->blocks->whichblock[xy] + 2*cr;
+    if (ds->xtype) {
+        if (ondiag0(xy))
+            regions[nr++] = 3*cr;
+        if (ondiag1(xy))
+            regions[nr++] = 3*cr+1;
+    }
+    if (state->kblocks)
+        regions[nr++] = state->kblocks->whichblock[xy] + 3*cr+2;
+
+    for (i = 0; i < nr; i++) {
+        int *count = &ds->entered_items[regions[i]*cr+d-1];
+        int before = *count;
+
+        *count += delta;
+        if ((before > 1) != (*count > 1))
+            mark_region_digit(ds, state, regions[i], d);
+    }
+}
+
+static int square_highlight(const game_drawstate *ds, const game_state *state,
+                            int x, int y)
+{
+    int cr = state->cr;
+    int highlight = 0;
+    digit d = state->grid[y*cr+x];
+
+    if (ds->flashing)
+        highlight = 1;
+
+    /* Highlight active input areas. */
+    if (x == ds->hx && y == ds->hy)
+        highlight = ds->hcursor;
+
+    /* Highlight hint number color */
+    if (ds->hhint != 0) {
+        digit p = state->pencil[(y*cr+x) * cr + (ds->hhint -1)];
+        if (p || (d == ds->hhint))
+            highlight = 4;
+    }
+
+    /* Mark obvious errors (ie, numbers which occur more than once
+     * in a single row, column, or box). */
+    if (d && (ds->entered_items[x*cr+d-1] > 1 ||
+              ds->entered_items[(y+cr)*cr+d-1] > 1 ||
+              ds->entered_items[(state->blocks->whichblock[y*cr+x]
+                                 +2*cr)*cr+d-1] > 1 ||
+              (ds->xtype && ((ondiag0(y*cr+x) &&
+                              ds->entered_items[(3*cr)*cr+d-1] > 1) ||
+                             (ondiag1(y*cr+x) &&
+                              ds->entered_items[(3*cr+1)*cr+d-1]>1)))||
+              (state->kblocks &&
+               ds->entered_items[(state->kblocks->whichblock[y*cr+x]
+                                  +3*cr+2)*cr+d-1] > 1)))
+        highlight |= 16;
+
+    if (d && state->kblocks) {
+        if (check_killer_cage_sum(
+                state->kblocks, state->kgrid, state->grid,
+                state->kblocks->whichblock[y*cr+x]) == 0)
+            highlight |= 32;
+    }
+
+    /* Highlight entry state in manual mode */
+    if (ds->entry)
+        highlight |= 64;
+
+    return highlight;
+}
+
 static void game_redraw(drawing *dr, game_drawstate *ds,
                         const game_state *oldstate, const game_state *state,
                         int dir, const game_ui *ui,
                         float animtime, float flashtime)
 {
     int cr = state->cr;
-    int x, y;
+    int x, y, i;
+    bool flashing, entry, all;
+    int hx, hy, hcursor, hhint;
 
     if (!ds->started) {
         /*
@@ -5372,96 +7128,92 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
     }
 
     /*
-     * This array is used to keep track of rows, columns and boxes
-     * which contain a number more than once.
+     * Work out the highlight inputs which apply to the whole grid.
+     * If the flash, the hint digit or the manual entry state has
+     * changed, every square has to be looked at; a moved cursor only
+     * affects the squares it left and arrived at.
      */
-    for (x = 0; x < cr * ds->nregions; x++)
-        ds->entered_items[x] = 0;
-    for (x = 0; x < cr; x++)
-        for (y = 0; y < cr; y++) {
-            digit d = state->grid[y*cr+x];
-            if (d) {
-                int box, kbox;
-
-                /* Rows */
-                ds->entered_items[x*cr+d-1]++;
-
-                /* Columns */
-                ds->entered_items[(y+cr)*cr+d-1]++;
-
-                /* Blocks */
-                box = state->blocks->whichblock[y*cr+x];
-                ds->entered_items[(box+2*cr)*cr+d-1]++;
-
-                /* Diagonals */
-                if (ds->xtype) {
-                    if (ondiag0(y*cr+x))
-                        ds->entered_items[(3*cr)*cr+d-1]++;
-                    if (ondiag1(y*cr+x))
-                        ds->entered_items[(3*cr+1)*cr+d-1]++;
-                }
+    flashing = (flashtime > 0 &&
+                (flashtime <= FLASH_TIME/3 || flashtime >= FLASH_TIME*2/3));
+    entry = state->manual && !state->fixed;
+    hhint = ui->hshow ? 0 : ui->hhint;
+    if (ui->hshow) {
+        hx = ui->hx;
+        hy = ui->hy;
+        hcursor = ui->hpencil ? 2 : 1;
+    } else {
+        hx = hy = -1;
+        hcursor = 0;
+    }
 
-                /* Killer cages */
+    all = (!ds->started || flashing != ds->flashing ||
+           entry != ds->entry || hhint != ds->hhint);
+    if (!all && (hx != ds->hx || hy != ds->hy || hcursor != ds->hcursor)) {
+        if (ds->hx >= 0)
+            mark_dirty(ds, ds->hy*cr+ds->hx);
+        if (hx >= 0)
+            mark_dirty(ds, hy*cr+hx);
+    }
+    ds->flashing = flashing;
+    ds->entry = entry;
+    ds->hhint = hhint;
+    ds->hx = hx;
+    ds->hy = hy;
+    ds->hcursor = hcursor;
+
+    /*
+     * Bring ds->entered_items, which keeps track of rows, columns
+     * and boxes which contain a number more than once, up to date
+     * with the new grid. After the first redraw, ds->grid holds the
+     * digits the counts were taken from, so only the squares which
+     * differ from it need counting again. Those squares, any square
+     * whose duplicate status flips as a result, and the rest of any
+     * Killer cage whose sum may have changed all need redrawing.
+     */
+    if (!ds->started) {
+        for (i = 0; i < cr * ds->nregions; i++)
+            ds->entered_items[i] = 0;
+        for (i = 0; i < cr*cr; i++)
+            if (state->grid[i])
+                count_digit(ds, state, i, state->grid[i], +1);
+    } else {
+        for (i = 0; i < cr*cr; i++) {
+            digit od = ds->grid[i], nd = state->grid[i];
+
+            if (od != nd) {
+                if (od)
+                    count_digit(ds, state, i, od, -1);
+                if (nd)
+                    count_digit(ds, state, i, nd, +1);
+                mark_dirty(ds, i);
                 if (state->kblocks) {
-                    kbox = state->kblocks->whichblock[y*cr+x];
-                    ds->entered_items[(kbox+3*cr+2)*cr+d-1]++;
+                    int kbox = state->kblocks->whichblock[i], j;
+                    for (j = 0; j < state->kblocks->nr_squares[kbox]; j++)
+                        mark_dirty(ds, state->kblocks->blocks[kbox][j]);
                 }
+            } else if (memcmp(ds->pencil+i*cr, state->pencil+i*cr, cr)) {
+                mark_dirty(ds, i);
             }
         }
+    }
+
+    if (all) {
+        for (i = 0; i < cr*cr; i++)
+            mark_dirty(ds, i);
+    }
 
     /*
      * Draw any numbers which need redrawing.
      */
-    for (x = 0; x < cr; x++) {
-        for (y = 0; y < cr; y++) {
-            int highlight = 0;
-            digit d = state->grid[y*cr+x];
-
-            if (flashtime > 0 &&
-                (flashtime <= FLASH_TIME/3 ||
-                 flashtime >= FLASH_TIME*2/3))
-                highlight = 1;
-
-            /* Highlight active input areas. */
-            if (x == ui->hx && y == ui->hy && ui->hshow)
-                highlight = ui->hpencil ? 2 : 1;
-
-            /* Highlight hint number color */
-            if (!ui->hshow && ui->hhint != 0) {
-                digit p = state->pencil[(y*cr+x) * cr + (ui->hhint -1)];
-                if (p || (d == ui->hhint))
-                    highlight = 4;
-            }
+    for (i = 0; i < ds->ndirty; i++) {
+        int xy = ds->dirty[i];
 
-            /* Mark obvious errors (ie, numbers which occur more than once
-             * in a single row, column, or box). */
-            if (d && (ds->entered_items[x*cr+d-1] > 1 ||
-                      ds->entered_items[(y+cr)*cr+d-1] > 1 ||
-                      ds->entered_items[(state->blocks->whichblock[y*cr+x]
-                                         +2*cr)*cr+d-1] > 1 ||
-                      (ds->xtype && ((ondiag0(y*cr+x) &&
-                                      ds->entered_items[(3*cr)*cr+d-1] > 1) ||
-                                     (ondiag1(y*cr+x) &&
-                                      ds->entered_items[(3*cr+1)*cr+d-1]>1)))||
-                      (state->kblocks &&
-                       ds->entered_items[(state->kblocks->whichblock[y*cr+x]
-                                          +3*cr+2)*cr+d-1] > 1)))
-                highlight |= 16;
-
-            if (d && state->kblocks) {
-                if (check_killer_cage_sum(
-                        state->kblocks, state->kgrid, state->grid,
-                        state->kblocks->whichblock[y*cr+x]) == 0)
-                    highlight |= 32;
-            }
-
-            /* Highlight entry state in manual mode */
-            if (state->manual && !state->fixed)
-                highlight |= 64;
-
-            draw_number(dr, ds, state, x, y, highlight);
-        }
+        x = xy % cr;
+        y = xy / cr;
+        draw_number(dr, ds, state, x, y, square_highlight(ds, state, x, y));
+        ds->isdirty[xy] = false;
     }
+    ds->ndirty = 0;
 
     /*
      * Update the _entire_ grid if necessary.
@@ -5779,9 +7531,7 @@ static void game_print(drawing *dr, const game_state *state, int tilesize)
             if (state->grid[y*cr+x]) {
                 char str[2];
                 str[1] = '\0';
-                str[0] = state->grid[y*cr+x] + '0';
-                if (str[0] > '9')
-                    str[0] += 'a' - ('9'+1);
+                str[0] = digit_char(state->grid[y*cr+x]);
                 draw_text(dr, BORDER + x*TILE_SIZE + TILE_SIZE/2,
                           BORDER + y*TILE_SIZE + TILE_SIZE/2,
                           FONT_VARIABLE, TILE_SIZE/2,
@@ -5835,13 +7585,490 @@ const struct game thegame = {
 
 #ifdef STANDALONE_SOLVER
 
+static const char *const diffnames[] = {
+    "Trivial", "Basic", "Intermediate", "Advanced", "Extreme",
+    "Unreasonable", "Ambiguous", "Impossible"
+};
+
+static const char *const kdiffnames[] = {
+    "Trivial", "Simple", "Intermediate", "Advanced"
+};
+
+static long long solo_timer_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+    return clock() * (1000000000LL / CLOCKS_PER_SEC);
+#endif
+}
+
+/*
+ * Generate `count' puzzles from the given parameters and print
+ * their game ids, reporting the time taken on stderr.
+ */
+static void generate(const game_params *p, const char *seed, int count)
+{
+    random_state *rs = random_new(seed, strlen(seed));
+    char *pstr = encode_params(p, false);
+    long long start = solo_timer_ns();
+    int i;
+
+    for (i = 0; i < count; i++) {
+        char *aux = NULL;
+        char *desc = new_game_desc(p, rs, &aux, false);
+        printf("%s:%s\n", pstr, desc);
+        sfree(desc);
+        sfree(aux);
+    }
+
+    fprintf(stderr, "%d puzzles in %.3fs\n", count,
+            (solo_timer_ns() - start) / 1e9);
+    sfree(pstr);
+    random_free(rs);
+}
+
+/*
+ * Regression check on the grader: a fixed corpus of game ids, each
+ * with the difficulty (and, for Killer, the killer difficulty) the
+ * solver is expected to give it. Any change to the solver's data
+ * structures should leave every one of these alone.
+ */
+static const struct {
+    int diff, kdiff;                   /* kdiff is -1 for non-killer */
+    const char *id;
+} grade_corpus[] = {
+    { DIFF_BLOCK, -1,
+      "2x2:b2c1b4c2b" },
+    { DIFF_SIMPLE, -1,
+      "2x3:b2a6_4f5d1_6d2f1_4a5b" },
+    { DIFF_RECURSIVE, -1,
+      "2x3:b6c2_3e4c1_5c4e3_4c6b" },
+    { DIFF_BLOCK, -1,
+      "3x3:b6_3c9a2a7a5a8f6b7a1_2a8f7_5c1_4f1a8_3a9b2f1a3a5a4a5c8_6b" },
+    { DIFF_SIMPLE, -1,
+      "3x3:9a1b5d6_5a8_9a7a2_4a1a3h7a5d9_1_2d9a3h2a1a3_8a1a7_3a5_9d5b4a1" },
+    { DIFF_INTERSECT, -1,
+      "3x3:f9a6c6a2e2c7a5_1a8_2b5_7c9_1a7_6c7_3b9_1a2_8a4c2e9a3c3a1f" },
+    { DIFF_SET, -1,
+      "3x3:e5_7a4a6d5_8a3c4f9_4c5a2b1a8b9a1c7_4f5c6a2_8d1a5a1_2e" },
+    { DIFF_EXTREME, -1,
+      "3x3:c9a3_7a2e7a4_5c5b9_3b1_4d2a3b4a2b9a8d3_5b5_3b6c2_7a3e6a1_2a4c" },
+    { DIFF_RECURSIVE, -1,
+      "3x3:6d3b7d8c3_5e2a4b7_4_9b5_1b6c7b1_8b5_7_3b2a9e6_8c7d7b1d2" },
+    { DIFF_SIMPLE, -1,
+      "3x3x:c3f9b8c5a4_6b9a2a8_5i3c2i3_6a3a8b4_6a6c5b7f7c" },
+    { DIFF_EXTREME, -1,
+      "3x3x:b7_6f2c9h1_5c7e2c2_7a6_3c6e9c1_9h4c3f8_4b" },
+    { DIFF_RECURSIVE, -1,
+      "3x3x:e9c8f2a2_7d9b4c5a8d2c5d8a1c9b7d3_8a1f7c6e" },
+    { DIFF_SET, -1,
+      "3x4:d8_6a9_11c2e4a3_9_1a8c10a1b7d4d3_12b11a6c11a8a3b9a12_3c5b7b5b3"
+      "c7_12a6b2a5a11c8a7b1_9d5d3b10a4c5a7_8_4a9e1c5_2a8_6d" },
+    { DIFF_INTERSECT, -1,
+      "4x4:e6_12a1a3_8_11c2_8b7b10b4_15a14a6f8b13_5_12a16b5_1d9b2a10_7_12"
+      "_8d11_10f14a4a12a6a15_2a3_4c13c11_4_10a1a8c3c2_7_13_13_2_12e4a15d5"
+      "_8d14a13e10_3_1_9_13_1c7c11a12a6_14_12c9c13_14a16_5a2a11a10a4f5_13"
+      "d3_11_4_12a10b7d16_9b2a8_3_16b5f16a8a1_13b2b6b12_4c7_15_9a5a8_16e" },
+    { DIFF_BLOCK, -1,
+      "9j:8_7a9_5c6d4f5d2_7c1b3a8a5a6a9a7a5a4b7c7_8d6f7d4c9_3a8_5,_dba_ac"
+      "ebba__e_cc_aa_d_abeecabb____a_aa_aa_aba_a__ba__ca_bdc" },
+    { DIFF_SIMPLE, -1,
+      "9j:b6d1d6e1_3c6b7_5_9c8o1c4_9_6b8c3_5e3d7d5b,ebaa_f_aa_c_aa_accbba"
+      "b_b__cdacb_cba__a_aaaaa_b_ab___ba_ecada" },
+    { DIFF_INTERSECT, -1,
+      "9j:2_3a4h9b6c7_4_6d2k6_5a2_4k7d6_9_8c5b7h5a9_3,adcaacb_ab___acba_c"
+      "ab_e__baif____aa_b__b___aaabaaaacaac_bdaa" },
+    { DIFF_SET, -1,
+      "9j:l6a5b1b2a8f1_3b2d6_5a4_3d4b3_1f9a5b8b7a2l,bacaa__bab_aa_bababaa"
+      "ab_a_abafb_daac_dbbaae_ba_acac_aa__acd" },
+    { DIFF_EXTREME, -1,
+      "9j:b8a6a5b5f2_1_4a1a8c7b3u4b8c5a2a6_9_1f8b4a2a7b,bgabbfgd___a_a__b"
+      "_e_bdcbdbaa_b_a___a_aba__d__a_b__a_b__c_abb" },
+    { DIFF_RECURSIVE, -1,
+      "9j:b8_5d1_1e3a5e2b9j7e1j3b9e8a9e2_7d6_9b,aadc__c___aa__c______bdac"
+      "___aa_aa_cfd_b__b_b_e_a__aadaa__b_da___be_" },
+    { DIFF_SIMPLE, -1,
+      "9jx:e4a9d9f2g6a4a1f2c5f5a4a1g6f3d4a7e,cac_ab_a_a___aabaaa___baa_aa"
+      "aaabaaca_f__a_f_b_c_c__abab_bafa__ag" },
+    { DIFF_INTERSECT, -1,
+      "9jx:d5e1_6a8f7a6a4d2d3b6b9b4b7d6d8a4a3f7a5_8e3d,_ce_f_d_b_bcbcg_fa"
+      "bee_baba_a_aacaa______c_b_baaaaaacb_b" },
+    { DIFF_SET, -1,
+      "9jx:i7a5a3a8d3c6c8_7g6e1g7_9c2c5d4a6a3a1i,bhaa__cb_bcb_cb_aaaa_c__"
+      "a_bdbibbac__aacc__a__c_ba_ab_da_c" },
+    { DIFF_EXTREME, -1,
+      "9jx:d2l1b2a4d7_3g5_7e1_2g7_8d9a5b3l1d,b_cbabaaab_bbc__b_ac_ba_beb_"
+      "gbcadaa__ca_a__a_aba_aaab_aaa__bac" },
+    { DIFF_RECURSIVE, -1,
+      "9jx:c8c5a7l2e6_4a3q1a9_4e6l6a7c4c,_bbc_baaa_ba_a____ab__acad_baacg"
+      "fcaab_bd_aa__a_da_b_c_bddb_" },
+    { DIFF_SIMPLE, -1,
+      "6j:j4c4_3_1_6_6_1_3_2c3j,a_c__b___baaadc_c_d__cb_bc" },
+    { DIFF_SET, -1,
+      "6j:d5e1d1d2d3e4d,b_aba___abbbbe__aa__ac__b__bb" },
+    { DIFF_INTERSECT, -1,
+      "12j:c8_10_5_1a6a7i11b6b12_9_3d7j4_5_3f3a7e12_8_6a9a5h5a4a1_11_6e4a"
+      "8f10_3_1j5d11_3_2b1b2i8a4a7_6_1_2c,a_hdaa_abh_bbb___b_ba__baacabcb"
+      "__iaad_h__dbehab_baad_babda_a_a_c__a__c_ba_d__b__ab_aac___aa__a_a_"
+      "aaca__bdb" },
+    { DIFF_BLOCK, DIFF_KINTERSECT,
+      "3x3k:zzzc,__a___aa____aa___aa_aacaaba__a__a__a___a_cccaaab_aa_aab_"
+      "a__a_aa_a_baab_aa_a_aa_aca_,5_26_9a12_19_14_15d10e16c11a10a37b36b1"
+      "3f9g25a9_8_19b13_12f25c6a28c7e11b" },
+    { DIFF_INTERSECT, DIFF_KINTERSECT,
+      "3x3k:zzzc,ac_babaa___aa___ba___ba___a__a__aba_baaaa__cb__b_aba_a_d"
+      "a_ac_aaa_a_aa____b____ad,12a14c27_17a4a32d11a33b29_13a7a3e36e13a17"
+      "c36e21c30_6i14b16g8a6b" },
+    { DIFF_SIMPLE, DIFF_KINTERSECT,
+      "9jk:zzzc,_deada_b_______b_b__aaa_a_ab_aabc_ed_b___aaac__dabfaabbab"
+      "dbe,_aa_baa_cbabac_baa_a_a_aa_c__acaae__aaa_ad___a_b__a_b_a__a__a_"
+      "_a_aa_ba___bba_,11_20a38a11_39k7d9c34a5a29c11_11c19e39a13b28b6g15b"
+      "10a16f6a28d" },
+    { DIFF_INTERSECT, DIFF_KINTERSECT,
+      "9jk:zzzc,_kbbbe_baca_cbc___ccabfacaa_a_a_aa__aa_a__ba_____a__aba_a"
+      "bccb,bba_____a____a_____a______a__a__b_a_a_aa_a___a_aaabfabbabc_ba"
+      "_c__a_e__ab__ac_abaa,25b10b6a15a17_7a24_12a5a35d32_13a15a13_36d35r"
+      "10a26a13i19a10a14e13c" },
+    { DIFF_SET, DIFF_KINTERSECT,
+      "9jk:zzzc,bacbd_bb____c_aa_____a_c_ab_b__adj___e_b_a_bac___bbb_aaaa"
+      "aab_cda,abb__a___________b__b_a__a__a_a__b_a_a__a_accaa__ad_b_bc__"
+      "ab__aaaaaab_a_a__abab_a_b,35a11b14b10_16a22a7_11_11e9c24e24c10_6a3"
+      "3_22b4b19d22a25i25_17c28m" },
+    { DIFF_SIMPLE, DIFF_KINTERSECT,
+      "4x4k:zzzzzzzzzv,_a__a_aa__a____b______a_a_b_____d__aa____c__ac__a_"
+      "___a_a___a_a_____a_aa_a____b_aa___aab_a_____aab____aa_bb___aa___ab"
+      "a_aa_bb____bbaa___baaaa_____acbaa__aaba_aca_aa__b_b____a_aa___ca_a"
+      "_a____a_aa__a___a___b_a_c_bb____cbb_____cca__ca_aaab_bacba_aaa_aaa"
+      "_aa____ba__b___a_aa_aa_aa__c__abcbab_ac,15_16a12_25_27a69_14a19a30"
+      "_10_13b15_22e14_15_31_19b76a40c11g23f23c16a47a12d18a23a18e14a18b23"
+      "_15_15a16a7_22a27b20a5d20_15_14a22b28a22b40a27d39c45c27_29b9a27a81"
+      "e18e48a11d23a11a13a50c37f32a18c17_21a64_79f12_9k51_10_51a50b71a19c"
+      "31k15b4d7a50f31j23c" },
+    { DIFF_INTERSECT, DIFF_KINTERSECT,
+      "4x4k:zzzzzzzzzv,c__a_aaa_a___a_a_b_a_aa_a_c__a____a_c___________ca"
+      "__a_____c__a__aa__b__a___abb___a___aaa____a___aaa____aac_c__c_a_ab"
+      "_b___a_a_a_a______a__a____a____ac_aaa__ccaaa_a____aaaa_a___aaaaaaa"
+      "a_a__ab_b__a__b__aab_ab_aca_aa__a_baaaa_a_ca__a_aa_bb_a_aa_ba__a_d"
+      "ca_a_a_baaaaa_____ac____a___ac____dacb_aa,33c3_15_65a45_24a35a14a2"
+      "6_40_14a3e42a37e21b35g62d27a27b14_24j35_18_13c23_16_19a120c13d13a3"
+      "6c23f16_31a13_5e40c9_18a29c9_8i11_26_50a24a7_31a35a7a51_23_12e25e2"
+      "3d17_44d46c20c17c31c12_56a22b12a33a23c18_3d26a67_27c19d29_16a8d8a4"
+      "9_16a40_11d17_11i19a21g" },
+    { DIFF_SET, DIFF_KINTERSECT,
+      "4x4k:zzzzzzzzzv,b__aa_aaaa__caaa_b___aa__aa_a___b________aabb_____"
+      "b_baba__a__b_a__a_baacaaab______a__a_a__________a_a_a_a__aa_____ac"
+      "a________aaa___babaa__a_b_caaa_aaba_aaaa_aaca__a_aa_aa___ad_aa__a_"
+      "_caaa_a__a__aa____aaa_a______ac__aa__aa_a___d__a_da_a__a_aba__aac_"
+      "b___abac__ba_caaa_aa__ea_aa__abaaaaaa,30b11_29_20a26a61_18a58a71a1"
+      "5d22i28a65b26_24_12_20c52f17d24h11c59c122f34b52_22c26c5d14c22_9c9b"
+      "64e17b11d11e26_9a15a28d30_20a17_8_8a19a25_10_14a15_17c57c17_17_8b4"
+      "4b15a11b18_55d7c6_8_31f86b6a5_48c64a54_27a10_39c26b22m35b13d59b10o" },
+    { DIFF_INTERSECT, DIFF_KINTERSECT,
+      "3x4k:zzzzzn,a_a__aaa_a_a_acaa_baa_abb__a_ac__a__a_ba___a____a__a__"
+      "______b______a_a_a__b_baaa_d__cab___acb__a_aa____a_aa____aaa_c__ba"
+      "a____e___aa_a_caa__bb_a__b____aaaaea,7a8_11a40_22_7a53a15_14b16d55"
+      "c33e12e61_12a13b18h5_5_16a14b46f10b12d42b35a56_13a11b6a18_5d40a12e"
+      "18g37a5_17c3_11a33l35b18a16g" },
+    { DIFF_SIMPLE, DIFF_KINTERSECT,
+      "4x4xk:zzzzzzzzzv,ba_c__a__a___aa__a_aa_aaa_abaaaa____aa_aa___a___a"
+      "_a____aa__b____a_ca______a_a__a___a_a_ac___a_a__aaa___aaaab_______"
+      "___c__ba____ada_____a_a_aa__c__a_aaaaa_eccaa_a____a_a_a__a__aaaba_"
+      "a_aaaba___aaa___a____aaa________baa_a__abaaab___aa___ab__d__aab_a_"
+      "aaaa_c_____aa__baa_a____eaa____aeac___aacc____,64b19a9_43c22_13_66"
+      "a49_30a26a15_27a12a21l19a27a21h44a6c66a24a36c43b12_12a39a20f27a14b"
+      "16a44c18a59d33b5_16d18g28_14c18c19a125b54c18_40b13a15_19f41_16c30_"
+      "14b32h16_7b26c15e3_47c15_24b27d69h5_8a21a12e29a6_43_72b23a12_24a25"
+      "_12b16g17a15e17e16b23b" },
+    { DIFF_IMPOSSIBLE, -1,
+      "3x3:1d3b7d8c3_5e2a4b7_4_9b5_1b6c7b1_8b5_7_3b2a9e6_8c7d7b1d2" },
+    { DIFF_AMBIGUOUS, -1,
+      "3x3:6d3b7dac3_5e2a4b7_4_9b5_1b6c7b1_8b5_7_3b2a9e6_8c7d7b1d2" },
+};
+
+static int check_grading(const char *prog)
+{
+    int i, n = lenof(grade_corpus), nbad = 0;
+
+    for (i = 0; i < n; i++) {
+        game_params *p = default_params();
+        game_state *s;
+        char *id = dupstr(grade_corpus[i].id), *desc = strchr(id, ':');
+        const char *err;
+        struct difficulty dlev;
+
+        *desc++ = '\0';
+        decode_params(p, id);
+        err = validate_desc(p, desc);
+        if (err) {
+            fprintf(stderr, "%s: corpus entry %d: %s\n", prog, i, err);
+            return 1;
+        }
+        s = new_game(NULL, p, desc);
+
+        dlev.maxdiff = DIFF_RECURSIVE;
+        dlev.maxkdiff = DIFF_KINTERSECT;
+        solver(s->cr, s->blocks, s->kblocks, s->xtype, s->grid, s->kgrid,
+               &dlev);
+        if (dlev.diff != grade_corpus[i].diff ||
+            (grade_corpus[i].kdiff >= 0 &&
+             dlev.kdiff != grade_corpus[i].kdiff)) {
+            printf("mismatch: %s:%s: expected %s/%s, got %s/%s\n",
+                   id, desc, diffnames[grade_corpus[i].diff],
+                   s->killer ? kdiffnames[grade_corpus[i].kdiff] : "-",
+                   diffnames[dlev.diff],
+                   s->killer ? kdiffnames[dlev.kdiff] : "-");
+            nbad++;
+        }
+
+        free_game(s);
+        free_params(p);
+        sfree(id);
+    }
+
+    printf("%d puzzles graded, %d mismatches\n", n, nbad);
+    return nbad ? 1 : 0;
+}
+
+/*
+ * Batch solver, for checking a large corpus of game ids against the
+ * grader or for benchmarking: read them one per line from a file (or
+ * standard input), solve each fully, and print its line number,
+ * difficulty, killer difficulty, solve time and solution, followed
+ * by the throughput and the spread of solve times. Each solve time
+ * is averaged over `reps' runs. Blank lines and lines starting with
+ * `#' are skipped. benchmarks/solo_plus_hard16.txt holds a fixed set
+ * of hard 16x16 ids for timing the -s cap.
+ *
+ * Each worker takes the next line under the lock and parses it
+ * there too, since new_game() writes to globals; only the solving
+ * is done in parallel. Results are printed in input order, each as
+ * soon as every line before it has been.
+ */
+struct solo_batch {
+    FILE *fp;
+    int lineno;                        /* lines read so far */
+    int n, size;                       /* puzzles taken, and room for */
+    int printed;                       /* puzzles whose results are out */
+    int errors;
+    int reps;                          /* solves per puzzle, for timing */
+    char **out;                        /* unprinted results, by puzzle */
+    long long *times;                  /* solve times, -1 for errors */
+#ifdef USE_PTHREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+static void batch_lock(struct solo_batch *b)
+{
+#ifdef USE_PTHREADS
+    pthread_mutex_lock(&b->lock);
+#endif
+}
+
+static void batch_unlock(struct solo_batch *b)
+{
+#ifdef USE_PTHREADS
+    pthread_mutex_unlock(&b->lock);
+#endif
+}
+
+static void *batch_worker(void *vb)
+{
+    struct solo_batch *b = (struct solo_batch *)vb;
+    struct solver_ctx *sctx = NULL;
+    char buf[65536];
+
+    batch_lock(b);
+    while (fgets(buf, sizeof(buf), b->fp)) {
+        game_params *p = NULL;
+        game_state *s = NULL;
+        char *desc, *out, *q;
+        digit *grid;
+        const char *err = NULL;
+        struct difficulty dlev;
+        long long t = -1;
+        int k, line, cr, i;
+
+        line = ++b->lineno;
+        buf[strcspn(buf, "\r\n")] = '\0';
+        if (!*buf || *buf == '#')
+            continue;
+
+        k = b->n++;
+        if (b->n > b->size) {
+            b->size = b->size * 3 / 2 + 64;
+            b->out = sresize(b->out, b->size, char *);
+            b->times = sresize(b->times, b->size, long long);
+        }
+        b->out[k] = NULL;
+
+        desc = strchr(buf, ':');
+        if (!desc) {
+            err = "game id expects a colon in it";
+        } else {
+            *desc++ = '\0';
+            p = default_params();
+            decode_params(p, buf);
+            err = validate_params(p, true);
+            if (!err)
+                err = validate_desc(p, desc);
+            if (!err)
+                s = new_game(NULL, p, desc);
+        }
+        batch_unlock(b);
+
+        if (s) {
+            cr = s->cr;
+            if (sctx && (sctx->usage.cr != cr ||
+                         sctx->usage.xtype != s->xtype)) {
+                solver_ctx_free(sctx);
+                sctx = NULL;
+            }
+            if (!sctx)
+                sctx = solver_ctx_new(cr, s->blocks, s->xtype);
+            else
+                solver_ctx_set_blocks(sctx, s->blocks);
+
+            grid = snewn(cr*cr, digit);
+            t = solo_timer_ns();
+            for (i = 0; i < b->reps; i++) {
+                memcpy(grid, s->grid, cr*cr);
+                dlev.maxdiff = DIFF_RECURSIVE;
+                dlev.maxkdiff = DIFF_KINTERSECT;
+                solver_ctx_solve(sctx, s->kblocks, grid, s->kgrid, &dlev);
+            }
+            t = (solo_timer_ns() - t) / b->reps;
+
+            out = snewn(100 + cr*cr*3, char);
+            q = out + sprintf(out, "%6d %-12s %-12s %10.3f ms ", line,
+                              diffnames[dlev.diff],
+                              s->killer ? kdiffnames[dlev.kdiff] : "-",
+                              t / 1e6);
+            if (dlev.diff == DIFF_AMBIGUOUS || dlev.diff == DIFF_IMPOSSIBLE)
+                q += sprintf(q, "-");
+            else
+                for (i = 0; i < cr*cr; i++)
+                    q += sprintf(q, cr > 9 && i ? ",%d" : "%d", grid[i]);
+            sprintf(q, "\n");
+            sfree(grid);
+            free_game(s);
+        } else {
+            out = snewn(strlen(err) + 40, char);
+            sprintf(out, "%6d error: %s\n", line, err);
+        }
+        if (p)
+            free_params(p);
+
+        batch_lock(b);
+        b->out[k] = out;
+        b->times[k] = t;
+        if (t < 0)
+            b->errors++;
+        while (b->printed < b->n && b->out[b->printed]) {
+            fputs(b->out[b->printed], stdout);
+            sfree(b->out[b->printed]);
+            b->printed++;
+        }
+    }
+    batch_unlock(b);
+
+    if (sctx)
+        solver_ctx_free(sctx);
+    return NULL;
+}
+
+static int batch_cmp_time(const void *av, const void *bv)
+{
+    long long a = *(const long long *)av, b = *(const long long *)bv;
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+
+/*
+ * Nearest-rank q-th percentile of n sorted times, in milliseconds.
+ */
+static double batch_percentile(const long long *times, int n, int q)
+{
+    return times[(n * q + 99) / 100 - 1] / 1e6;
+}
+
+static int batch(const char *prog, const char *filename, int threads,
+                 int reps)
+{
+    struct solo_batch b;
+    long long start, wall, total = 0;
+    int i, nsolved;
+
+    b.fp = filename ? fopen(filename, "r") : stdin;
+    if (!b.fp) {
+        fprintf(stderr, "%s: %s: %s\n", prog, filename, strerror(errno));
+        return 1;
+    }
+    b.lineno = b.n = b.size = b.printed = b.errors = 0;
+    b.reps = reps;
+    b.out = NULL;
+    b.times = NULL;
+
+    start = solo_timer_ns();
+#ifdef USE_PTHREADS
+    pthread_mutex_init(&b.lock, NULL);
+    if (threads > 1) {
+        pthread_t *workers = snewn(threads, pthread_t);
+
+        for (i = 0; i < threads; i++)
+            pthread_create(&workers[i], NULL, batch_worker, &b);
+        for (i = 0; i < threads; i++)
+            pthread_join(workers[i], NULL);
+        sfree(workers);
+    } else
+#endif
+    {
+        threads = 1;
+        batch_worker(&b);
+    }
+#ifdef USE_PTHREADS
+    pthread_mutex_destroy(&b.lock);
+#endif
+    wall = solo_timer_ns() - start;
+    if (filename)
+        fclose(b.fp);
+
+    /*
+     * Sort the solve times of the puzzles that parsed, pushing the
+     * errors (-1) to the front out of the way.
+     */
+    qsort(b.times, b.n, sizeof *b.times, batch_cmp_time);
+    nsolved = b.n - b.errors;
+    for (i = b.errors; i < b.n; i++)
+        total += b.times[i];
+
+    printf("%d puzzles (%d errors) in %.3fs on %d thread%s: "
+           "%.1f puzzles/s\n", b.n, b.errors, wall / 1e9, threads,
+           threads == 1 ? "" : "s", b.n / (wall / 1e9));
+    if (nsolved)
+        printf("solve time: mean %.3f ms, p50 %.3f ms, p90 %.3f ms, "
+               "p99 %.3f ms, max %.3f ms\n", total / 1e6 / nsolved,
+               batch_percentile(b.times + b.errors, nsolved, 50),
+               batch_percentile(b.times + b.errors, nsolved, 90),
+               batch_percentile(b.times + b.errors, nsolved, 99),
+               batch_percentile(b.times + b.errors, nsolved, 100));
+
+    sfree(b.out);
+    sfree(b.times);
+    return b.errors ? 1 : 0;
+}
+
 int main(int argc, char **argv)
 {
     game_params *p;
     game_state *s;
     char *id = NULL, *desc;
     const char *err;
-    bool grade = false;
+    const char *seed = "1";
+    bool grade = false, batchmode = false, check = false;
+    int reps = 1, threads = 0;
     struct difficulty dlev;
 
     while (--argc > 0) {
@@ -5850,6 +8077,22 @@ int main(int argc, char **argv)
             solver_show_working = true;
         } else if (!strcmp(p, "-g")) {
             grade = true;
+        } else if (!strcmp(p, "-n") && argc > 1) {
+            reps = atoi(*++argv);
+            argc--;
+        } else if (!strcmp(p, "-s") && argc > 1) {
+            solver_set_max = atoi(*++argv);
+            argc--;
+        } else if (!strcmp(p, "-j") && argc > 1) {
+            threads = atoi(*++argv);
+            argc--;
+        } else if (!strcmp(p, "--check")) {
+            check = true;
+        } else if (!strcmp(p, "--batch")) {
+            batchmode = true;
+        } else if (!strcmp(p, "--seed") && argc > 1) {
+            seed = *++argv;
+            argc--;
         } else if (*p == '-') {
             fprintf(stderr, "%s: unrecognised option `%s'\n", argv[0], p);
             return 1;
@@ -5858,20 +8101,61 @@ int main(int argc, char **argv)
         }
     }
 
+    if (check)
+        return check_grading(argv[0]);
+    if (batchmode) {
+        if (solver_show_working && threads > 1) {
+            fprintf(stderr, "%s: -v is not supported with more than one "
+                    "thread\n", argv[0]);
+            return 1;
+        }
+#ifndef USE_PTHREADS
+        if (threads > 1)
+            fprintf(stderr, "%s: built without thread support, "
+                    "ignoring -j\n", argv[0]);
+#endif
+        return batch(argv[0], id, threads, reps < 1 ? 1 : reps);
+    }
+
     if (!id) {
-        fprintf(stderr, "usage: %s [-g | -v] <game_id>\n", argv[0]);
+        fprintf(stderr, "usage: %s [-s maxset] [-g | -v] <game_id>\n"
+                "       %s [-s maxset] [-n reps] [-j threads] --batch "
+                "[game_id_list]\n"
+                "       %s [-n count] [-j threads] [--seed seed] <params>\n"
+                "       %s [-s maxset] --check\n",
+                argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
 
+#ifdef USE_PTHREADS
+    solo_gen_threads = max(threads, 0);
+#else
+    if (threads > 0)
+        fprintf(stderr, "%s: built without thread support, "
+                "ignoring -j\n", argv[0]);
+#endif
+
+    p = default_params();
     desc = strchr(id, ':');
+    if (desc)
+        *desc++ = '\0';
+    decode_params(p, id);
+
     if (!desc) {
-        fprintf(stderr, "%s: game id expects a colon in it\n", argv[0]);
-        return 1;
+        err = validate_params(p, true);
+        if (err) {
+            fprintf(stderr, "%s: %s\n", argv[0], err);
+            return 1;
+        }
+        if (solver_show_working) {
+            fprintf(stderr, "%s: -v is not supported when generating\n",
+                    argv[0]);
+            return 1;
+        }
+        generate(p, seed, reps < 1 ? 1 : reps);
+        return 0;
     }
-    *desc++ = '\0';
 
-    p = default_params();
-    decode_params(p, id);
     err = validate_desc(p, desc);
     if (err) {
         fprintf(stderr, "%s: %s\n", argv[0], err);
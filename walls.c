@@ -8,6 +8,9 @@
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#ifdef STANDALONE_SOLVER
+#include <time.h>
+#endif
 
 #include "puzzles.h"
 
@@ -439,15 +442,164 @@ static int check_solution(game_state *state, bool full) {
     return solved;
 }
 
+/*
+ * The solver passes, in the order walls_solve() tries them.
+ */
+#define PASSLIST(A) \
+    A(SINGLE_CELLS,solve_single_cells) \
+    A(EARLY_EXITS,solve_early_exits) \
+    A(LOOPS,solve_loops) \
+    A(PARTITIONS,solve_partitions) \
+    A(LOOP_LADDERS,solve_loop_ladders) \
+    A(EXIT_PARITY,solve_exit_parity) \
+    A(PARITY,solve_parity)
+#define PASSENUM(upper,fn) PASS_ ## upper,
+#define PASSNAME(upper,fn) #fn,
+enum { PASSLIST(PASSENUM) NPASSES };
+static char const *const walls_passnames[] = { PASSLIST(PASSNAME) };
+
+/*
+ * Optional solver statistics. walls_solve() adds to these when the
+ * scratch has a stats pointer. A deduction is a run of a pass that
+ * changed the grid, however many edges it placed. Pass times are only
+ * measured in the standalone tool; elsewhere 'ns' stays zero.
+ */
+struct walls_pass_stats {
+    long invocations;
+    long deductions;
+    long long ns;
+};
+
+struct walls_solve_stats {
+    long solves;                /* calls to walls_solve() */
+    long check_solution_calls;
+    struct walls_pass_stats pass[NPASSES];
+};
+
+/*
+ * Statistics from one or more generator runs. 'gen' covers every solve
+ * the generator made; 'puzzle' is a solve of the finished puzzle at its
+ * own difficulty, i.e. the work a player's deductions have to do.
+ */
+struct walls_stats {
+    int attempts;       /* Hamiltonian paths generated */
+    int too_easy;       /* attempts rejected as solvable one level lower */
+    struct walls_solve_stats gen;
+    struct walls_solve_stats puzzle;
+};
+
+#ifdef STANDALONE_SOLVER
+static bool solver_verbose = false;
+
+static long long walls_timer_ns(void) {
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+    return clock() * (1000000000LL / CLOCKS_PER_SEC);
+#endif
+}
+#endif
+
+/*
+ * Solver scratch space. This is allocated once for a given grid size
+ * and reset before each solve, so that the generator's many trial
+ * solves don't go back to the allocator every time.
+ *
+ * done_islands and island_free cache, for each sub-rectangle
+ * examined by solve_parity(), how many undecided edges it had when it
+ * last yielded no deduction. Edges only ever go from undecided to
+ * decided during a solve, so an unchanged count means nothing inside
+ * the rectangle has changed and the check can be skipped. There are
+ * O(w^2 h^2) rectangles, so rather than clearing the cache for every
+ * solve, an entry counts as valid only if done_islands holds the
+ * current island_stamp.
+ */
 struct solver_scratch {
+    int w, h;
     int *loopdsf;
-    bool *done_islands;
+    unsigned int *done_islands;
+    int *island_free;
+    unsigned int island_stamp;
+    int islands;
     int island_counter;
     bool exits_found;
     int difficulty;
     bool verbose;
+    struct walls_solve_stats *stats;   /* optional, may be NULL */
+
+    /* Per-technique working buffers */
+    int *dsf;
+    int *freesum;        /* (w+1)*(h+1) prefix sums of undecided edges */
+    int *cellroot;       /* block-local dsf root of each block cell */
+    int *group_size;     /* cells in the group, indexed by root */
+    int *group_next;     /* CSR fill cursor, indexed by root */
+    int *group_roots;    /* roots in order of their smallest cell */
+    int *group_cells;    /* cells bucketed by group, in index order */
+    gridstate grid;
+    struct findloopstate *fls;
 };
 
+static struct solver_scratch *new_scratch(int w, int h) {
+    struct solver_scratch *scratch = snew(struct solver_scratch);
+    int i;
+
+    scratch->w = w;
+    scratch->h = h;
+    scratch->islands = (((w-1)*(w))*((h-1)*(h)))/4;
+    scratch->loopdsf = snewn(w*h, int);
+    scratch->done_islands = snewn(scratch->islands, unsigned int);
+    scratch->island_free = snewn(scratch->islands, int);
+    for (i=0;i<scratch->islands;i++) scratch->done_islands[i] = 0;
+    scratch->island_stamp = 0;
+
+    scratch->dsf = snewn(w*h, int);
+    scratch->freesum = snewn((w+1)*(h+1), int);
+    scratch->cellroot = snewn(w*h, int);
+    scratch->group_size = snewn(w*h, int);
+    scratch->group_next = snewn(w*h, int);
+    scratch->group_roots = snewn(w*h, int);
+    scratch->group_cells = snewn(w*h, int);
+    scratch->grid.w = w;
+    scratch->grid.h = h;
+    scratch->grid.faces = snewn(w*h, unsigned char);
+    scratch->fls = findloop_new_state(w*h);
+    scratch->stats = NULL;
+
+    return scratch;
+}
+
+static void reset_scratch(struct solver_scratch *scratch,
+                          int difficulty, bool verbose) {
+    int i;
+
+    dsf_init(scratch->loopdsf, scratch->w*scratch->h);
+    if (++scratch->island_stamp == 0) {
+        for (i=0;i<scratch->islands;i++) scratch->done_islands[i] = 0;
+        scratch->island_stamp = 1;
+    }
+    scratch->exits_found = false;
+    scratch->difficulty = difficulty;
+    scratch->verbose = verbose;
+}
+
+static void free_scratch(struct solver_scratch *scratch) {
+    findloop_free_state(scratch->fls);
+    sfree(scratch->grid.faces);
+    sfree(scratch->group_cells);
+    sfree(scratch->group_roots);
+    sfree(scratch->group_next);
+    sfree(scratch->group_size);
+    sfree(scratch->cellroot);
+    sfree(scratch->freesum);
+    sfree(scratch->dsf);
+    sfree(scratch->island_free);
+    sfree(scratch->done_islands);
+    sfree(scratch->loopdsf);
+    sfree(scratch);
+}
+
 static bool solve_single_cells(game_state *state, struct solver_scratch *scratch) {
     int i, j, x, y;
     bool changed = false;
@@ -590,17 +742,22 @@ static bool solve_loop_ladders(game_state *state, struct solver_scratch *scratch
     return changed;
 }
 
-static bool check_partition(const game_state *state) {
-    int i,x,y;
+/*
+ * Any undecided interior edge whose removal would split the cells into
+ * two parts must be a path: the path has to visit both parts, and the
+ * only way between them is that edge. Those edges are exactly the
+ * bridges of the graph formed by the non-wall edges, so a single
+ * findloop pass finds all of them.
+ */
+static bool solve_partitions(game_state *state, struct solver_scratch *scratch) {
+    int i,x,y,u,v,nu,nv;
     int w = state->w;
     int h = state->h;
+    bool changed = false;
     unsigned char *edges[4];
-    int *dsf;
-    int first_cell;
+    gridstate *grid = &scratch->grid;
+    struct neighbour_ctx ctx;
 
-    /* Check if all cells can be connected */
-    dsf = snewn(w*h,int);
-    dsf_init(dsf, w*h);
     for (y=0;y<h;y++)
     for (x=0;x<w;x++) {
         i = x+y*w;
@@ -608,52 +765,44 @@ static bool check_partition(const game_state *state) {
         edges[1] = edges[0] + w;
         edges[2] = state->edge_v + y*(w+1) + x;
         edges[3] = edges[2] + 1;
-        if ((*edges[0] & FLAG_WALL) == 0x00 && y>0)   dsf_merge(dsf, i, i-w);
-        if ((*edges[1] & FLAG_WALL) == 0x00 && y<h-1) dsf_merge(dsf, i, i+w);
-        if ((*edges[2] & FLAG_WALL) == 0x00 && x>0)   dsf_merge(dsf, i, i-1);
-        if ((*edges[3] & FLAG_WALL) == 0x00 && x<w-1) dsf_merge(dsf, i, i+1);
-    }
-    first_cell = dsf_canonify(dsf, 0);
-    for (i=0;i<w*h;i++) {
-        if (dsf_canonify(dsf, i) != first_cell) {
-            sfree(dsf);
-            return false;
-        }
+        grid->faces[i] = BLANK;
+        if ((*edges[0] & FLAG_WALL) == 0x00) grid->faces[i] |= U;
+        if ((*edges[1] & FLAG_WALL) == 0x00) grid->faces[i] |= D;
+        if ((*edges[2] & FLAG_WALL) == 0x00) grid->faces[i] |= L;
+        if ((*edges[3] & FLAG_WALL) == 0x00) grid->faces[i] |= R;
     }
-    sfree(dsf);
-    return true;
-}
-
-static bool solve_partitions(game_state *state, struct solver_scratch *scratch) {
-    int i;
-    int w = state->w;
-    int h = state->h;
-    for (i=0;i<w*(h+1);i++) {
-        if (state->edge_h[i] == FLAG_NONE) {
-            state->edge_h[i] = FLAG_WALL;
-            if (!check_partition(state)) {
-                if (scratch->verbose)
-                    printf("Horizontal edge at %i would partition the board -> set to path\n",i);
-                state->edge_h[i] = FLAG_PATH;
-                return true;
-            }
-            state->edge_h[i] = FLAG_NONE;
+    ctx.grid = grid;
+    findloop_run(scratch->fls, w*h, neighbour, &ctx);
+
+    /*
+     * Only bridges spanning the whole grid count; if the grid is
+     * already in pieces the position is contradictory and there is
+     * nothing sensible to deduce.
+     */
+    for (i=w;i<w*h;i++) {
+        if (state->edge_h[i] != FLAG_NONE) continue;
+        u = i-w; v = i;
+        if (findloop_is_bridge(scratch->fls, u, v, &nu, &nv) && nu+nv == w*h) {
+            if (scratch->verbose)
+                printf("Horizontal edge at %i would partition the board -> set to path\n",i);
+            state->edge_h[i] = FLAG_PATH;
+            changed = true;
         }
     }
-    for (i=0;i<(w+1)*h;i++) {
-        if (state->edge_v[i] == FLAG_NONE) {
-            state->edge_v[i] = FLAG_WALL;
-            if (!check_partition(state)) {
-                if (scratch->verbose)
-                    printf("Vertical edge at %i would partition the board -> set to path\n",i);
-                state->edge_v[i] = FLAG_PATH;
-                return true;
-            }
-            state->edge_v[i] = FLAG_NONE;
+    for (y=0;y<h;y++)
+    for (x=1;x<w;x++) {
+        i = x+y*(w+1);
+        if (state->edge_v[i] != FLAG_NONE) continue;
+        u = (x-1)+y*w; v = x+y*w;
+        if (findloop_is_bridge(scratch->fls, u, v, &nu, &nv) && nu+nv == w*h) {
+            if (scratch->verbose)
+                printf("Vertical edge at %i would partition the board -> set to path\n",i);
+            state->edge_v[i] = FLAG_PATH;
+            changed = true;
         }
     }
 
-    return false;
+    return changed;
 }
 
 static inline bool parity(int x, int y) {
@@ -662,45 +811,55 @@ static inline bool parity(int x, int y) {
 
 static bool parity_check_block(game_state *state, struct solver_scratch *scratch,
     int bx, int by, int bw, int bh) {
-    int i,j,n,x,y,f;
+    int i,n,x,y,f,g,ngroups;
     int h = state->h;
     int w = state->w;
     unsigned char *edges[4];
-    int *dsf;
-    bool found;
-    bool result = false;
-    int processed_count = 0;
-    int *processed_cells = snewn(w*h, int);
-    int *group_cells = snewn(w*h, int);
-
-    scratch->done_islands[scratch->island_counter] = true;
-
-    /* Build a dsf over the relevant area */
-    dsf = snewn(w*h,int);
-    dsf_init(dsf, w*h);
+    int *dsf = scratch->dsf;
+    int *cellroot = scratch->cellroot;
+    int *group_size = scratch->group_size;
+    int *group_next = scratch->group_next;
+    int *group_roots = scratch->group_roots;
+    int *group_cells = scratch->group_cells;
+
+    /*
+     * Build a dsf over the relevant area. It is indexed by the
+     * block-local cell number (x-bx)+(y-by)*bw, which runs in the same
+     * order as the global cell index.
+     */
+    dsf_init(dsf, bw*bh);
     for (y=by;y<by+bh;y++)
     for (x=bx;x<bx+bw;x++) {
-        i = x+y*w;
+        i = (x-bx)+(y-by)*bw;
         edges[0] = state->edge_h + y*w + x;
         edges[1] = edges[0] + w;
         edges[2] = state->edge_v + y*(w+1) + x;
         edges[3] = edges[2] + 1;
-        if ((*edges[0] & FLAG_WALL) == 0x00 && y>by)        dsf_merge(dsf, i, i-w);
-        if ((*edges[1] & FLAG_WALL) == 0x00 && y<(by+bh)-1) dsf_merge(dsf, i, i+w);
-        if ((*edges[2] & FLAG_WALL) == 0x00 && x>bx)        dsf_merge(dsf, i, i-1);
+        if ((*edges[1] & FLAG_WALL) == 0x00 && y<(by+bh)-1) dsf_merge(dsf, i, i+bw);
         if ((*edges[3] & FLAG_WALL) == 0x00 && x<(bx+bw)-1) dsf_merge(dsf, i, i+1);
-        for (j=0;j<4;j++)
-            if (*edges[j] == FLAG_NONE)
-                scratch->done_islands[scratch->island_counter] = false;
     }
 
-    if (scratch->done_islands[scratch->island_counter]) {
-        goto finish_parity;
+    /*
+     * Bucket the cells by dsf root in one pass: count the group sizes,
+     * lay the groups out back to back in order of their smallest cell,
+     * then drop each cell into its group's slot.
+     */
+    ngroups = 0;
+    for (i=0;i<bw*bh;i++) group_size[i] = 0;
+    for (i=0;i<bw*bh;i++) {
+        f = cellroot[i] = dsf_canonify(dsf, i);
+        if (group_size[f]++ == 0) group_roots[ngroups++] = f;
+    }
+    for (g=0,n=0;g<ngroups;g++) {
+        group_next[group_roots[g]] = n;
+        n += group_size[group_roots[g]];
     }
+    for (y=by;y<by+bh;y++)
+    for (x=bx;x<bx+bw;x++)
+        group_cells[group_next[cellroot[(x-bx)+(y-by)*bw]]++] = x+y*w;
 
     /* Process each separate dsf group */
-    for (i=0;i<w*h;i++) processed_cells[i] = -1;
-    while(true) {
+    for (g=0;g<ngroups;g++) {
         int count_black, count_white;
         int avail_black, avail_white;
         int paths_black, paths_white;
@@ -714,62 +873,38 @@ static bool parity_check_block(game_state *state, struct solver_scratch *scratch
         bool black_used_max_paths, white_used_max_paths;
         bool fill_paths_white, fill_paths_black;
         bool fill_walls_white, fill_walls_black;
+        bool border[4];
         
-        int group_count = 0;
+        int group_count;
+        int *cells;
+
+        f = group_roots[g];
+        group_count = group_size[f];
+        cells = group_cells + group_next[f] - group_count;
+        if (group_count == 1) continue;
 
         count_black = count_white = 0;
         avail_black = avail_white = 0;
         paths_black = paths_white = 0;
         walls_black = walls_white = 0;
 
-        for (i=0;i<w*h;i++) {
-            found = false;
-            for (j=0;j<w*h;j++) {
-                if (processed_cells[j] == i) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) break;
-        }
-        if (i==w*h) break;
-
-        f = dsf_canonify(dsf, i);
-        for (n = 0; n < w*h; n++) {
-            if (dsf_canonify(dsf, n) == f) {
-                processed_cells[processed_count++] = n;
-                group_cells[group_count++] = n;
-                x = n%state->w; y=n/state->w;
-                parity(x,y) ? count_white++ : count_black++;
-            }
-        }
-        if (group_count == 1) continue;
-
         for (n=0;n<group_count;n++) {
-            x = group_cells[n]%w; y=group_cells[n]/w;
+            x = cells[n]%w; y=cells[n]/w;
+            i = (x-bx)+(y-by)*bw;
+            parity(x,y) ? count_white++ : count_black++;
             edges[0] = state->edge_h + y*w + x;
             edges[1] = edges[0] + w;
             edges[2] = state->edge_v + y*(w+1) + x;
             edges[3] = edges[2] + 1;
-            if (y == by || dsf_canonify(dsf, x+(y-1)*w) != f) {
-                if ((*edges[0] & FLAG_WALL) == 0)         parity(x,y) ? avail_white++ : avail_black++;
-                if ((*edges[0] & FLAG_PATH) == FLAG_PATH) parity(x,y) ? paths_white++ : paths_black++;
-                if ((*edges[0] & FLAG_WALL) == FLAG_WALL) parity(x,y) ? walls_white++ : walls_black++;
-            }
-            if (y == by+bh-1 || dsf_canonify(dsf, x+(y+1)*w) != f) {
-                if ((*edges[1] & FLAG_WALL) == 0)         parity(x,y) ? avail_white++ : avail_black++;
-                if ((*edges[1] & FLAG_PATH) == FLAG_PATH) parity(x,y) ? paths_white++ : paths_black++;
-                if ((*edges[1] & FLAG_WALL) == FLAG_WALL) parity(x,y) ? walls_white++ : walls_black++;
-            }
-            if (x == bx || dsf_canonify(dsf, (x-1)+y*w) != f) {
-                if ((*edges[2] & FLAG_WALL) == 0)         parity(x,y) ? avail_white++ : avail_black++;
-                if ((*edges[2] & FLAG_PATH) == FLAG_PATH) parity(x,y) ? paths_white++ : paths_black++;
-                if ((*edges[2] & FLAG_WALL) == FLAG_WALL) parity(x,y) ? walls_white++ : walls_black++;
-            }
-            if (x == bx+bw-1 || dsf_canonify(dsf, (x+1)+y*w) != f) {
-                if ((*edges[3] & FLAG_WALL) == 0)         parity(x,y) ? avail_white++ : avail_black++;
-                if ((*edges[3] & FLAG_PATH) == FLAG_PATH) parity(x,y) ? paths_white++ : paths_black++;
-                if ((*edges[3] & FLAG_WALL) == FLAG_WALL) parity(x,y) ? walls_white++ : walls_black++;
+            border[0] = (y == by       || cellroot[i-bw] != f);
+            border[1] = (y == by+bh-1  || cellroot[i+bw] != f);
+            border[2] = (x == bx       || cellroot[i-1]  != f);
+            border[3] = (x == bx+bw-1  || cellroot[i+1]  != f);
+            for (i=0;i<4;i++) {
+                if (!border[i]) continue;
+                if ((*edges[i] & FLAG_WALL) == 0)         parity(x,y) ? avail_white++ : avail_black++;
+                if ((*edges[i] & FLAG_PATH) == FLAG_PATH) parity(x,y) ? paths_white++ : paths_black++;
+                if ((*edges[i] & FLAG_WALL) == FLAG_WALL) parity(x,y) ? walls_white++ : walls_black++;
             }
         }
 
@@ -807,103 +942,97 @@ static bool parity_check_block(game_state *state, struct solver_scratch *scratch
             if (scratch->verbose) {
                 printf("Block at %i/%i (%i/%i) ",bx,by,bw,bh);
                 printf("Size %i, black %i, white %i: ",
-                    dsf_size(dsf, i), count_black, count_white);
+                    group_count, count_black, count_white);
                 printf("Avail %i/%i, Paths %i/%i, Walls %i/%i ", avail_white, avail_black, paths_white, paths_black, walls_white, walls_black);
                 printf("Path fill %s/%s ", fill_paths_white ? "T" : "F",fill_paths_black ? "T" : "F");
                 printf("Wall fill %s/%s ", fill_walls_white ? "T" : "F",fill_walls_black ? "T" : "F");
                 printf("\n");
             }
             for (n=0;n<group_count;n++) {
-                x = group_cells[n]%w; y=group_cells[n]/w;
+                bool fill_path, fill_wall;
+                x = cells[n]%w; y=cells[n]/w;
+                i = (x-bx)+(y-by)*bw;
                 edges[0] = state->edge_h + y*w + x;
                 edges[1] = edges[0] + w;
                 edges[2] = state->edge_v + y*(w+1) + x;
                 edges[3] = edges[2] + 1;
-                if ((fill_paths_white && parity(x,y)) ||
-                    (fill_paths_black && !parity(x,y))) {
-                    if ((*edges[0] == FLAG_NONE) && 
-                        (y == by || dsf_canonify(dsf, x+(y-1)*w) != f)) {
-                        *edges[0] = FLAG_PATH;
-                        if (scratch->verbose)
-                            printf("Parity (%i/%i) block at %i/%i: Place path at cell %i direction U\n",
-                                   bw,bh,bx,by,group_cells[n]);
-                    }
-                    if ((*edges[1] == FLAG_NONE) && 
-                        (y == by+bh-1 || dsf_canonify(dsf, x+(y+1)*w) != f)) {
-                        *edges[1] = FLAG_PATH;
-                        if (scratch->verbose)
-                            printf("Parity (%i/%i) block at %i/%i: Place path at cell %i direction D\n",
-                                   bw,bh,bx,by,group_cells[n]);
-                    }
-                    if ((*edges[2] == FLAG_NONE) && 
-                        (x == bx || dsf_canonify(dsf, (x-1)+y*w) != f)) {
-                        *edges[2] = FLAG_PATH;
-                        if (scratch->verbose)
-                            printf("Parity (%i/%i) block at %i/%i: Place path at cell %i direction L\n",
-                                   bw,bh,bx,by,group_cells[n]);
-                    }
-                    if ((*edges[3] == FLAG_NONE) && 
-                        (x == bx+bw-1 || dsf_canonify(dsf, (x+1)+y*w) != f)) {
-                        *edges[3] = FLAG_PATH;
+                border[0] = (y == by       || cellroot[i-bw] != f);
+                border[1] = (y == by+bh-1  || cellroot[i+bw] != f);
+                border[2] = (x == bx       || cellroot[i-1]  != f);
+                border[3] = (x == bx+bw-1  || cellroot[i+1]  != f);
+                fill_path = (fill_paths_white && parity(x,y)) ||
+                            (fill_paths_black && !parity(x,y));
+                fill_wall = (fill_walls_white && parity(x,y)) ||
+                            (fill_walls_black && !parity(x,y));
+                for (i=0;i<4;i++) {
+                    if (fill_path && *edges[i] == FLAG_NONE && border[i]) {
+                        *edges[i] = FLAG_PATH;
                         if (scratch->verbose)
-                            printf("Parity (%i/%i) block at %i/%i: Place path at cell %i direction R\n",
-                                   bw,bh,bx,by,group_cells[n]);
+                            printf("Parity (%i/%i) block at %i/%i: Place path at cell %i direction %c\n",
+                                   bw,bh,bx,by,cells[n],"UDLR"[i]);
                     }
                 }
-                if ((fill_walls_white && parity(x,y)) ||
-                    (fill_walls_black && !parity(x,y))) {
-                    if ((*edges[0] == FLAG_NONE) && 
-                        (y == by || dsf_canonify(dsf, x+(y-1)*w) != f)) {
-                        *edges[0] = FLAG_WALL;
-                        if (scratch->verbose)
-                            printf("Parity (%i/%i) block at %i/%i: Place wall at cell %i direction U\n",
-                                   bw,bh,bx,by,group_cells[n]);
-                    }
-                    if ((*edges[1] == FLAG_NONE) && 
-                        (y == by+bh-1 || dsf_canonify(dsf, x+(y+1)*w) != f)) {
-                        *edges[1] = FLAG_WALL;
-                        if (scratch->verbose)
-                            printf("Parity (%i/%i) block at %i/%i: Place wall at cell %i direction D\n",
-                                   bw,bh,bx,by,group_cells[n]);
-                    }
-                    if ((*edges[2] == FLAG_NONE) && 
-                        (x == bx || dsf_canonify(dsf, (x-1)+y*w) != f)) {
-                        *edges[2] = FLAG_WALL;
-                        if (scratch->verbose)
-                            printf("Parity (%i/%i) block at %i/%i: Place wall at cell %i direction L\n",
-                                   bw,bh,bx,by,group_cells[n]);
-                    }
-                    if ((*edges[3] == FLAG_NONE) && 
-                        (x == bx+bw-1 || dsf_canonify(dsf, (x+1)+y*w) != f)) {
-                        *edges[3] = FLAG_WALL;
+                for (i=0;i<4;i++) {
+                    if (fill_wall && *edges[i] == FLAG_NONE && border[i]) {
+                        *edges[i] = FLAG_WALL;
                         if (scratch->verbose)
-                            printf("Parity (%i/%i) block at %i/%i: Place wall at cell %i direction R\n",
-                                   bw,bh,bx,by,group_cells[n]);
+                            printf("Parity (%i/%i) block at %i/%i: Place wall at cell %i direction %c\n",
+                                   bw,bh,bx,by,cells[n],"UDLR"[i]);
                     }
                 }
             }
-            result = true;
-            goto finish_parity;
+            return true;
         }
     }
-    
-finish_parity:
-    sfree(group_cells);
-    sfree(processed_cells);
-    sfree(dsf);
-    return result;
+
+    return false;
+}
+
+/*
+ * Number of undecided edges touching cells in the given block, from
+ * the prefix sums in scratch->freesum. Edges inside the block count
+ * twice, which doesn't matter: it only has to drop whenever one of
+ * them is decided.
+ */
+static int block_free_edges(struct solver_scratch *scratch,
+                            int bx, int by, int bw, int bh) {
+    int *s = scratch->freesum;
+    int sw = scratch->w + 1;
+    return s[(by+bh)*sw + bx+bw] - s[by*sw + bx+bw]
+         - s[(by+bh)*sw + bx]    + s[by*sw + bx];
 }
 
 static bool solve_parity(game_state *state, struct solver_scratch *scratch) {
-    int w,h,x,y;
+    int w,h,x,y,k,nfree;
+    int sw = state->w + 1;
+    int *s = scratch->freesum;
+
+    for (x=0;x<sw;x++) s[x] = 0;
+    for (y=0;y<state->h;y++) {
+        int row = 0;
+        s[(y+1)*sw] = 0;
+        for (x=0;x<state->w;x++) {
+            row += (state->edge_h[y*state->w + x]     == FLAG_NONE) +
+                   (state->edge_h[(y+1)*state->w + x] == FLAG_NONE) +
+                   (state->edge_v[y*sw + x]           == FLAG_NONE) +
+                   (state->edge_v[y*sw + x+1]         == FLAG_NONE);
+            s[(y+1)*sw + x+1] = s[y*sw + x+1] + row;
+        }
+    }
+
     scratch->island_counter = 0;
     for (h=state->h;h>=2;h--) 
     for (w=state->w;w>=2;w--) {
         for (y=0;y<=state->h-h;y++)
         for (x=0;x<=state->w-w;x++) {
-            if (!scratch->done_islands[scratch->island_counter])
-                if (parity_check_block(state, scratch, x, y, w, h)) return true;
-            scratch->island_counter++;
+            k = scratch->island_counter++;
+            nfree = block_free_edges(scratch, x, y, w, h);
+            if (nfree == 0) continue;
+            if (scratch->done_islands[k] == scratch->island_stamp &&
+                scratch->island_free[k] == nfree) continue;
+            if (parity_check_block(state, scratch, x, y, w, h)) return true;
+            scratch->done_islands[k] = scratch->island_stamp;
+            scratch->island_free[k] = nfree;
         }
     }
     return false;
@@ -956,21 +1085,17 @@ static bool solve_early_exits(game_state *state, struct solver_scratch *scratch)
     return false;
 }
 
-static bool check_for_loops(game_state *state) {
+static bool check_for_loops(game_state *state, struct solver_scratch *scratch) {
     int i,x,y;
     int w = state->w;
     int h = state->h;
     bool result = false;
     unsigned char *edges[4];
 
-    gridstate *grid;
-    struct findloopstate *fls;
+    gridstate *grid = &scratch->grid;
+    struct findloopstate *fls = scratch->fls;
     struct neighbour_ctx ctx;
 
-    grid = snew(gridstate);
-    grid->faces = snewn(w*h, unsigned char);
-    grid->w = w; grid->h = h;
-
     for (y=0;y<h;y++)
     for (x=0;x<w;x++) {
         i = x+y*w;
@@ -984,7 +1109,6 @@ static bool check_for_loops(game_state *state) {
         if ((*edges[2] & FLAG_PATH) > 0x00) grid->faces[i] |= L;
         if ((*edges[3] & FLAG_PATH) > 0x00) grid->faces[i] |= R;
     }
-    fls = findloop_new_state(w*h);
     ctx.grid = grid;
     if (findloop_run(fls, w*h, neighbour, &ctx)) {
         for (x = 0; x < w; x++) {
@@ -1002,10 +1126,6 @@ static bool check_for_loops(game_state *state) {
     }
 
 finish_loopcheck:
-
-    findloop_free_state(fls);
-    sfree(grid->faces);
-    sfree(grid);
     return result;
 }
 
@@ -1017,7 +1137,7 @@ static bool solve_loops(game_state *state, struct solver_scratch *scratch) {
     for (i=0;i<w*(h+1);i++) {
         if (state->edge_h[i] == FLAG_NONE) {
             state->edge_h[i] = FLAG_PATH;
-            if (check_for_loops(state)) {
+            if (check_for_loops(state, scratch)) {
                 if (scratch->verbose)
                     printf("Horizontal path at %i would create a loop -> set to wall\n",i);
                 state->edge_h[i] = FLAG_WALL;
@@ -1029,7 +1149,7 @@ static bool solve_loops(game_state *state, struct solver_scratch *scratch) {
     for (i=0;i<(w+1)*h;i++) {
         if (state->edge_v[i] == FLAG_NONE) {
             state->edge_v[i] = FLAG_PATH;
-            if (check_for_loops(state)) {
+            if (check_for_loops(state, scratch)) {
                 if (scratch->verbose)
                     printf("Vertical path at %i would create a loop -> set to wall\n",i);
                 state->edge_v[i] = FLAG_WALL;
@@ -1173,39 +1293,65 @@ static bool solve_exit_parity(game_state *state, struct solver_scratch *scratch)
     return false;
 }
 
-static int walls_solve(game_state *state, int difficulty, bool verbose) {
-    int i;
-    int w = state->w;
-    int h = state->h;
-    int islands = (((w-1)*(w))*((h-1)*(h)))/4;
-    struct solver_scratch *scratch = snew(struct solver_scratch);
+typedef bool (*solver_pass)(game_state *state, struct solver_scratch *scratch);
 
-    scratch->loopdsf = snewn(w*h, int);
-    dsf_init(scratch->loopdsf, w*h);
-    scratch->done_islands = snewn(islands, bool);
-    scratch->exits_found = false;
-    scratch->difficulty = difficulty;
-    scratch->verbose = verbose;
-    for (i=0;i<islands;i++) scratch->done_islands[i] = false;
+static bool run_pass(game_state *state, struct solver_scratch *scratch,
+                     int pass, solver_pass fn) {
+    struct walls_pass_stats *ps;
+    bool ret;
+#ifdef STANDALONE_SOLVER
+    long long start;
+#endif
+
+    if (!scratch->stats) return fn(state, scratch);
+
+    ps = &scratch->stats->pass[pass];
+    ps->invocations++;
+#ifdef STANDALONE_SOLVER
+    start = walls_timer_ns();
+#endif
+    ret = fn(state, scratch);
+#ifdef STANDALONE_SOLVER
+    ps->ns += walls_timer_ns() - start;
+#endif
+    if (ret) ps->deductions++;
+    return ret;
+}
+
+static int counted_check(game_state *state, struct solver_scratch *scratch) {
+    if (scratch->stats) scratch->stats->check_solution_calls++;
+    return check_solution(state, false);
+}
+
+#define RUN(pass, fn) run_pass(state, scratch, PASS_ ## pass, fn)
+#define SOLVED_YET() (counted_check(state, scratch) == SOLVED)
+
+/*
+ * Setting 'verbose' prints the solver's working and keeps deducing
+ * even once the grid is complete, so it is only meant for the
+ * standalone tool.
+ */
+static int walls_solve(game_state *state, struct solver_scratch *scratch,
+                       int difficulty, bool verbose) {
+    assert(scratch->w == state->w && scratch->h == state->h);
+    reset_scratch(scratch, difficulty, verbose);
+    if (scratch->stats) scratch->stats->solves++;
 
     while(true) {
-        if (difficulty >= DIFF_EASY   && solve_single_cells(state, scratch)) continue;
-        if (difficulty >= DIFF_EASY   && solve_early_exits(state, scratch)) continue;
-        if (!verbose && check_solution(state, false) == SOLVED) break;
-        if (difficulty >= DIFF_NORMAL && solve_loops(state, scratch)) continue;
-        if (difficulty >= DIFF_NORMAL && solve_partitions(state, scratch)) continue;
-        if (!verbose && check_solution(state, false) == SOLVED) break;
-        if (difficulty >= DIFF_TRICKY && solve_loop_ladders(state, scratch)) continue;
-        if (difficulty >= DIFF_TRICKY && solve_exit_parity(state, scratch)) continue;
-        if (!verbose && check_solution(state, false) == SOLVED) break;
-        if (difficulty >= DIFF_HARD   && solve_parity(state, scratch)) continue;
+        if (difficulty >= DIFF_EASY   && RUN(SINGLE_CELLS, solve_single_cells)) continue;
+        if (difficulty >= DIFF_EASY   && RUN(EARLY_EXITS, solve_early_exits)) continue;
+        if (!verbose && SOLVED_YET()) break;
+        if (difficulty >= DIFF_NORMAL && RUN(LOOPS, solve_loops)) continue;
+        if (difficulty >= DIFF_NORMAL && RUN(PARTITIONS, solve_partitions)) continue;
+        if (!verbose && SOLVED_YET()) break;
+        if (difficulty >= DIFF_TRICKY && RUN(LOOP_LADDERS, solve_loop_ladders)) continue;
+        if (difficulty >= DIFF_TRICKY && RUN(EXIT_PARITY, solve_exit_parity)) continue;
+        if (!verbose && SOLVED_YET()) break;
+        if (difficulty >= DIFF_HARD   && RUN(PARITY, solve_parity)) continue;
         break;
     }
 
-    sfree(scratch->done_islands);
-    sfree(scratch->loopdsf);
-    sfree(scratch);
-    return check_solution(state, false);
+    return counted_check(state, scratch);
 }
 
 /*
@@ -1213,9 +1359,27 @@ static int walls_solve(game_state *state, int difficulty, bool verbose) {
  * 
  * Employing the algorithm described at:
  * http://clisby.net/projects/hamiltonian_path/
+ *
+ * The path is kept as parallel coordinate arrays plus a position
+ * index 'pos' mapping each cell (x+y*w) to its index in the path, or
+ * -1 if the cell is not yet covered. This makes the neighbour lookup
+ * in each backbite move O(1); only the reversal itself is linear.
  */
 
-static void reverse_path(int i1, int i2, int *pathx, int *pathy) {
+/*
+ * Stopping as soon as the path first covers the grid gives a
+ * noticeably non-uniform sample. Each cell of the grid buys this many
+ * extra backbite moves once the path is complete, so the amount of
+ * mixing grows with the grid. Zero reproduces the plain sampler.
+ */
+#ifdef STANDALONE_SOLVER
+static int path_mix_factor = 0;
+#else
+#define path_mix_factor 0
+#endif
+
+static void reverse_path(int i1, int i2, int *pathx, int *pathy,
+                         int *pos, int w) {
     int i;
     int ilim = (i2-i1+1)/2;
     int temp;
@@ -1227,12 +1391,16 @@ static void reverse_path(int i1, int i2, int *pathx, int *pathy) {
         temp = pathy[i1+i];
         pathy[i1+i] = pathy[i2-i];
         pathy[i2-i] = temp;
+
+        pos[pathx[i1+i] + pathy[i1+i]*w] = i1+i;
+        pos[pathx[i2-i] + pathy[i2-i]*w] = i2-i;
     }
 }
 
-static int backbite_left(int step, int n, int *pathx, int *pathy, int w, int h) {
+static int backbite_left(int step, int n, int *pathx, int *pathy,
+                         int *pos, int w, int h) {
     int neighx, neighy;
-    int i, inPath = false;
+    int i;
     switch(step) {
         case L: neighx = pathx[0]-1; neighy = pathy[0];   break;
         case R: neighx = pathx[0]+1; neighy = pathy[0];   break;
@@ -1243,25 +1411,26 @@ static int backbite_left(int step, int n, int *pathx, int *pathy, int w, int h)
     if (neighx < 0 || neighx >= w || neighy < 0 || neighy >= h)
         return n;
 
-    for (i=1;i<n;i+=2) {
-        if (neighx == pathx[i] && neighy == pathy[i]) { inPath = true; break; }
-    }
-    if (inPath) {
-        reverse_path(0, i-1, pathx, pathy);
+    /* A grid neighbour of the head always sits at an odd path index */
+    i = pos[neighx + neighy*w];
+    if (i >= 0) {
+        reverse_path(0, i-1, pathx, pathy, pos, w);
     }
     else {
-        reverse_path(0, n-1, pathx, pathy);
+        reverse_path(0, n-1, pathx, pathy, pos, w);
         pathx[n] = neighx;
         pathy[n] = neighy;
+        pos[neighx + neighy*w] = n;
         n++;
     }
 
     return n;
 }
 
-static int backbite_right(int step, int n, int *pathx, int *pathy, int w, int h) {
+static int backbite_right(int step, int n, int *pathx, int *pathy,
+                          int *pos, int w, int h) {
     int neighx, neighy;
-    int i, inPath = false;
+    int i;
     switch(step) {
         case L: neighx = pathx[n-1]-1; neighy = pathy[n-1];   break;
         case R: neighx = pathx[n-1]+1; neighy = pathy[n-1];   break;
@@ -1272,55 +1441,63 @@ static int backbite_right(int step, int n, int *pathx, int *pathy, int w, int h)
     if (neighx < 0 || neighx >= w || neighy < 0 || neighy >= h)
         return n;
 
-    for (i=n-2;i>=0;i-=2) {
-        if (neighx == pathx[i] && neighy == pathy[i]) { inPath = true; break; }
-    }
-    if (inPath) {
-        reverse_path(i+1, n-1, pathx, pathy);
+    i = pos[neighx + neighy*w];
+    if (i >= 0) {
+        reverse_path(i+1, n-1, pathx, pathy, pos, w);
     }
     else {
         pathx[n] = neighx;
         pathy[n] = neighy;
+        pos[neighx + neighy*w] = n;
         n++;
     }
 
     return n;
 }
 
-static int backbite(int n, int *pathx, int *pathy, int w, int h, random_state *rs) {
+static int backbite(int n, int *pathx, int *pathy, int *pos,
+                    int w, int h, random_state *rs) {
     return (random_upto(rs, 2) == 0) ?
-        backbite_left( DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, w, h) :
-        backbite_right(DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, w, h);
+        backbite_left( DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, pos, w, h) :
+        backbite_right(DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, pos, w, h);
 }
 
-static void generate_hamiltonian_path(game_state *state, random_state *rs) {
+static void generate_hamiltonian_path(game_state *state, random_state *rs,
+                                      int mix) {
     int w = state->w;
     int h = state->h;
     int *pathx = snewn(w*h, int);
     int *pathy = snewn(w*h, int);
+    int *pos = snewn(w*h, int);
     int n = 1;
-    int pos, x, y;
+    int i, x, y;
+
+    for (i=0;i<w*h;i++) pos[i] = -1;
     pathx[0] = random_upto(rs, w);
     pathy[0] = random_upto(rs, h);
+    pos[pathx[0] + pathy[0]*w] = 0;
 
     while (n < w*h) {
-        n = backbite(n, pathx, pathy, w, h, rs);
+        n = backbite(n, pathx, pathy, pos, w, h, rs);
+    }
+
+    for (i=0;i<mix*w*h;i++) {
+        backbite(n, pathx, pathy, pos, w, h, rs);
     }
 
     while (!(pathx[0] == 0 || pathx[0] == w-1) && 
            !(pathy[0] == 0 || pathy[0] == h-1)) {
-        backbite_left(DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, w, h);
+        backbite_left(DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, pos, w, h);
     }
 
     while (!(pathx[n-1] == 0 || pathx[n-1] == w-1) && 
            !(pathy[n-1] == 0 || pathy[n-1] == h-1)) {
-        backbite_right(DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, w, h);
+        backbite_right(DIRECTIONS[random_upto(rs,4)], n, pathx, pathy, pos, w, h);
     }
 
     for (n=0;n<w*h;n++) {
-        pos = pathx[n] + pathy[n]*w;
-        x = pos % w;
-        y = pos / w;
+        x = pathx[n];
+        y = pathy[n];
         if (n < (w*h-1)) {
             if      (pathx[n+1] - pathx[n] ==  1) state->edge_v[y*(w+1)+x+1] = FLAG_NONE;
             else if (pathx[n+1] - pathx[n] == -1) state->edge_v[y*(w+1)+x]   = FLAG_NONE;
@@ -1337,6 +1514,7 @@ static void generate_hamiltonian_path(game_state *state, random_state *rs) {
 
     sfree(pathx);
     sfree(pathy);
+    sfree(pos);
 
     return;
 }
@@ -1380,6 +1558,13 @@ static game_state *dup_state(const game_state *state) {
     return ret;
 }
 
+/* Reset a solver trial state to the edges of 'src' without reallocating */
+static void copy_edges(game_state *dst, const game_state *src) {
+    assert(dst->w == src->w && dst->h == src->h);
+    memcpy(dst->edge_h, src->edge_h, src->w*(src->h + 1) * sizeof(unsigned char));
+    memcpy(dst->edge_v, src->edge_v, (src->w + 1)*src->h * sizeof(unsigned char));
+}
+
 static void free_state(game_state *state) {
     sfree(state->edge_v);
     sfree(state->edge_h);
@@ -1407,8 +1592,13 @@ static void count_edges(unsigned char edge, char **e, int *erun, int *wrun) {
     else                 (*erun)++;
 }
 
-static char *new_game_desc(const game_params *params, random_state *rs,
-                           char **aux, bool interactive) {
+/*
+ * Generate a puzzle description. If 'stats' is not NULL, the counts and
+ * timings of this generation are added to it, and the finished puzzle
+ * is solved once more to fill in stats->puzzle.
+ */
+static char *generate_desc(const game_params *params, random_state *rs,
+                           struct walls_stats *stats) {
     game_state *new;
     game_state *tmp;
     
@@ -1427,8 +1617,12 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     int vo = w*(h+1);
     int *wallidx;
     int result;
+    struct solver_scratch *scratch;
 
     wallidx = snewn(ws, int);
+    scratch = new_scratch(w, h);
+    scratch->stats = stats ? &stats->gen : NULL;
+    tmp = new_state(params);
     
     while (true) {
         borderreduce = difficulty == DIFF_EASY   ? random_upto(rs, 4) :
@@ -1436,8 +1630,9 @@ static char *new_game_desc(const game_params *params, random_state *rs,
                                                    2*w+2*h;
 
         wallnum = bordernum = 0;
+        if (stats) stats->attempts++;
         new = new_state(params);
-        generate_hamiltonian_path(new, rs);
+        generate_hamiltonian_path(new, rs, path_mix_factor);
 
         for (i=0;i<w*(h+1);i++)
             if ((new->edge_h[i] & FLAG_WALL) > 0x00)
@@ -1481,34 +1676,44 @@ static char *new_game_desc(const game_params *params, random_state *rs,
             }
 
             /* Temporarily remove wall, check if game is still solveable */
-            tmp = dup_state(new);
+            copy_edges(tmp, new);
             if (wi<vo) tmp->edge_h[wi]    = FLAG_NONE;
             else       tmp->edge_v[wi-vo] = FLAG_NONE;
             
             /* It is, remove this wall permanently */
-            if (walls_solve(tmp, difficulty, false) == SOLVED) {
+            if (walls_solve(tmp, scratch, difficulty, false) == SOLVED) {
                 if (wi<vo) new->edge_h[wi]    = FLAG_NONE;
                 else       new->edge_v[wi-vo] = FLAG_NONE;
                 if (wi<vo && (wi/w == 0 || wi/w == h)) bordernum++;
                 else if ((wi-vo)%(w+1) == 0 || (wi-vo)%(w+1) == w) bordernum++;
             }
-            free_state(tmp);
         }
         if (difficulty == DIFF_EASY) break;
-        tmp = dup_state(new);
-        result = walls_solve(tmp, difficulty-1, false);
-        free_state(tmp);
+        copy_edges(tmp, new);
+        result = walls_solve(tmp, scratch, difficulty-1, false);
         if (result == SOLVED) {
-            printf("Puzzle too easy - continue\n");
+            if (stats) stats->too_easy++;
+#ifdef STANDALONE_SOLVER
+            if (solver_verbose) printf("Puzzle too easy - continue\n");
+#endif
             free_state(new);
             continue;
         }
         break;
     }
-    printf("We have a puzzle! Solution:\n");
-    tmp = dup_state(new);
-    result = walls_solve(tmp, difficulty, true);
-    free_state(tmp);
+    if (stats) {
+        scratch->stats = &stats->puzzle;
+        copy_edges(tmp, new);
+        walls_solve(tmp, scratch, difficulty, false);
+    }
+#ifdef STANDALONE_SOLVER
+    if (solver_verbose) {
+        printf("We have a puzzle! Solution:\n");
+        scratch->stats = NULL;
+        copy_edges(tmp, new);
+        walls_solve(tmp, scratch, difficulty, true);
+    }
+#endif
 
     /* Encode walls */
     desc = snewn((w+1)*h + w*(h+1) + (w*h) + 1, char);
@@ -1529,13 +1734,22 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     while (erun >= 25) {*e++ = 'z'; erun -= 25; }
     if(erun > 0) *e++ = ('a' + erun - 1);
     *e++ = '\0';
-    printf("Description: %s\n", desc);
+#ifdef STANDALONE_SOLVER
+    if (solver_verbose) printf("Description: %s\n", desc);
+#endif
     free_state(new);
+    free_state(tmp);
+    free_scratch(scratch);
     sfree(wallidx);
 
     return desc;
 }
 
+static char *new_game_desc(const game_params *params, random_state *rs,
+                           char **aux, bool interactive) {
+    return generate_desc(params, rs, NULL);
+}
+
 static const char *validate_desc(const game_params *params, const char *desc) {
     return NULL;
 }
@@ -1580,14 +1794,12 @@ static game_state *new_game(midend *me, const game_params *params,
             desc++;
         }
         else if (*desc == ',') {
-            printf("i: %i, w*(h+1): %i\n",i, w*(h+1));
             assert(i == w*(h+1));
             fh = false;
             i = 0;
             desc++;
         }
     }
-    printf("i: %i, (w+1)*h: %i\n",i, (w+1)*h);
     assert(i == (w+1)*h);
     return state;
 }
@@ -1609,7 +1821,9 @@ static char *solve_game(const game_state *state, const game_state *currstate,
     int voff = w*(h+1);
     
     game_state *solve_state = dup_game(state);
-    walls_solve(solve_state, DIFF_HARD, true);
+    struct solver_scratch *scratch = new_scratch(w, h);
+    walls_solve(solve_state, scratch, DIFF_HARD, false);
+    free_scratch(scratch);
     p += sprintf(p, "S");
     for (i = 0; i < w*(h+1); i++) {
         if (solve_state->edge_h[i] == FLAG_WALL)
@@ -1739,11 +1953,29 @@ static void game_changed_state(game_ui *ui, const game_state *oldstate,
     (btn) == CURSOR_DOWN ? D : (btn) == CURSOR_UP ? U :\
     (btn) == CURSOR_LEFT ? L : R)
 
+/*
+ * The board is drawn as a (8w+5) x (8h+5) array of small tiles. Besides
+ * what is currently on each tile, the drawstate remembers the edges,
+ * cell states, cursor and drag it last drew, so that game_redraw() only
+ * needs to recompute the tiles around whatever has changed since.
+ */
 struct game_drawstate {
     int tilesize;
     int w, h;
     bool tainted;
     unsigned long *cell;
+
+    unsigned char *edge_h;
+    unsigned char *edge_v;
+    unsigned char *cellstate;
+    int curx, cury;
+    bool cursor_active;
+    bool show_grid;
+    unsigned short flashflag;
+
+    int *dragcoords;       /* drag tiles as last drawn */
+    int ndragcoords;
+    bool *dragmap;         /* per tile: part of the current drag */
 };
 
 static char *mark_in_direction(const game_state *state, int x, int y, int dir,
@@ -1802,7 +2034,6 @@ static char *interpret_move(const game_state *state, game_ui *ui,
         }
         else {
             ui->ndragcoords = -1;
-            printf("Clicked on cell %i/%i\n",fx,fy);
             if ((fx<0 && fy<0) || (fx>=w && fy<0) || (fx<0 && fy>=h) || (fx>=w && fy>=h)) return NULL;
             if      (fx<0 && x > cx)  dir = R;
             else if (fx>=w && x < cx) dir = L;
@@ -1975,10 +2206,31 @@ static game_drawstate *game_new_drawstate(drawing *dr, const game_state *state)
 
     for (i=0;i<(8*w+5)*(8*h+5); i++) ds->cell[i] = 0x00000000;
 
+    ds->edge_h = snewn(w*(h+1), unsigned char);
+    ds->edge_v = snewn((w+1)*h, unsigned char);
+    ds->cellstate = snewn((w+2)*(h+2), unsigned char);
+    memcpy(ds->edge_h, state->edge_h, w*(h+1)*sizeof(unsigned char));
+    memcpy(ds->edge_v, state->edge_v, (w+1)*h*sizeof(unsigned char));
+    memcpy(ds->cellstate, state->cellstate, (w+2)*(h+2)*sizeof(unsigned char));
+    ds->curx = ds->cury = 0;
+    ds->cursor_active = false;
+    ds->show_grid = true;
+    ds->flashflag = FLAG_NONE;
+
+    ds->dragcoords = snewn((8*w+5)*(8*h+5), int);
+    ds->ndragcoords = 0;
+    ds->dragmap = snewn((8*w+5)*(8*h+5), bool);
+    for (i=0;i<(8*w+5)*(8*h+5); i++) ds->dragmap[i] = false;
+
     return ds;
 }
 
 static void game_free_drawstate(drawing *dr, game_drawstate *ds) {
+    sfree(ds->dragmap);
+    sfree(ds->dragcoords);
+    sfree(ds->cellstate);
+    sfree(ds->edge_v);
+    sfree(ds->edge_h);
     sfree(ds->cell);
     sfree(ds);
 }
@@ -2049,126 +2301,208 @@ static void draw_cell(drawing *dr, game_drawstate *ds, int pos) {
 
 #define CURSOR(x,y) (ui->cursor_active && (x) == ui->curx && (y) == ui->cury)
 
+static unsigned long tile_contents(const game_drawstate *ds,
+                                   const game_state *state, const game_ui *ui,
+                                   unsigned short flashflag, int i) {
+    int w = state->w, h = state->h;
+    int x,y,j,cx,cy,csx,csy;
+    unsigned char cellerror;
+    unsigned long ret = ds->dragmap[i] ? FLAG_DRAG : 0x00000000;
+
+    x = i%(8*w+5)-2; y = i/(8*w+5)-2;
+    cx = x/8; cy = y/8;
+    csx = (x<0) ? 0 : cx+1; csy = (y<0) ? 0 : cy+1;
+
+    cellerror = state->cellstate[csx+csy*(w+2)];
+
+    /* Corner border cells. Unused. */
+    if ((x<0 && y<0) || (x<0 && y>8*h) || (x>8*w && y<0) || (x>8*w && y>8*h)) {}
+
+    /* Left / Right border cells */
+    else if (x<0 || x>8*w) {
+        if (y%8==4 && x==-1)
+            ret |= flashflag|(state->edge_v[cy*(w+1)]   & (FLAG_PATH|cellerror));
+        if (y%8==4 && x==8*w+1)
+            ret |= flashflag|(state->edge_v[w+cy*(w+1)] & (FLAG_PATH|cellerror));
+    }
+
+    /* Top / Bottom border cells */
+    else if (y<0 || y>8*h) {
+        if (x%8==4 && y==-1)
+            ret |= flashflag|(state->edge_h[cx]         & (FLAG_PATH|cellerror));
+        if (x%8==4 && y==8*h+1)
+            ret |= flashflag|(state->edge_h[cx+h*w]     & (FLAG_PATH|cellerror));
+    }
+
+    /* 4-Corner cells */
+    else if ((x%8 == 0) && (y%8 == 0)) {
+        if (ui->show_grid) {
+            if (cx>0 && cy>0)
+                ret |= CURSOR(cx-1,cy-1) ? 0x0300 : 
+                              parity(cx-1,cy-1) ? 0x0100 : 0x0200;
+            if (cx>0 && cy<h)
+                ret |= CURSOR(cx-1,cy)   ? 0x0c00 :
+                              parity(cx-1,cy)   ? 0x0400 : 0x0800;
+            if (cx<w && cy>0)
+                ret |= CURSOR(cx,cy-1)   ? 0x3000 :
+                              parity(cx,cy-1)   ? 0x1000 : 0x2000;
+            if (cx<w && cy<h)
+                ret |= CURSOR(cx,cy)     ? 0xc000 :
+                              parity(cx,cy)     ? 0x4000 : 0x8000;
+        }
+        if (cx > 0) ret |= state->edge_h[(cx-1)+cy*w]     & (FLAG_WALL | FLAG_FIXED);
+        if (cx < w) ret |= state->edge_h[cx+cy*w]         & (FLAG_WALL | FLAG_FIXED);
+        if (cy > 0) ret |= state->edge_v[cx+(cy-1)*(w+1)] & (FLAG_WALL | FLAG_FIXED);
+        if (cy < h) ret |= state->edge_v[cx+cy*(w+1)]     & (FLAG_WALL | FLAG_FIXED);
+    }
+
+    /* Horizontal edge cells */
+    else if (y%8 == 0) {
+        if (ui->show_grid) {
+            if (cy > 0) ret |= CURSOR(cx,cy-1) ? 0x3300 : parity(cx,cy-1) ? 0x1100:0x2200;
+            if (cy < h) ret |= CURSOR(cx,cy)   ? 0xcc00 : parity(cx,cy)   ? 0x4400:0x8800;
+        }
+        ret |= state->edge_h[cx+cy*w] & (FLAG_WALL|FLAG_FIXED);
+        if (x%8==4) {
+            ret |= flashflag|(state->edge_h[cx+cy*w] & (FLAG_PATH|FLAG_ERROR));
+            if ((ret & FLAG_PATH)>0) ret |= cellerror;
+        }
+    }
+
+    /* Vertical edge cells */
+    else if (x%8 == 0) {
+        if (ui->show_grid) {
+            if (cx > 0) ret |= CURSOR(cx-1,cy) ? 0x0f00 :
+                                      parity(cx-1,cy) ? 0x0500 : 0x0a00;
+            if (cx < w) ret |= CURSOR(cx,cy)   ? 0xf000 :
+                                      parity(cx,cy)   ? 0x5000 : 0xa000;
+        }
+        ret |= state->edge_v[cx+cy*(w+1)] & (FLAG_WALL|FLAG_FIXED);
+        if (y%8==4) {
+            ret |= flashflag|(state->edge_v[cx+cy*(w+1)] & (FLAG_PATH|FLAG_ERROR));
+            if ((ret & FLAG_PATH)>0) ret |= cellerror;
+        }
+    }
+    
+    /* Path cells */
+    else {
+        if (ui->show_grid) 
+            for (j=0;j<4;j++) ret |= (CURSOR(cx,cy) ? 0x03 :
+                                             parity(cx,cy) ? 0x01:0x02) << (8+2*j);
+        if (x%8==4 && y%8<=4)
+            ret |= flashflag|(state->edge_h[cx+cy*w]         & (FLAG_PATH|cellerror));
+        if (x%8==4 && y%8>=4)
+            ret |= flashflag|(state->edge_h[cx+(cy+1)*w]     & (FLAG_PATH|cellerror));
+        if (y%8==4 && x%8<=4)
+            ret |= flashflag|(state->edge_v[cx+cy*(w+1)]     & (FLAG_PATH|cellerror));
+        if (y%8==4 && x%8>=4)
+            ret |= flashflag|(state->edge_v[(cx+1)+cy*(w+1)] & (FLAG_PATH|cellerror));
+        if (x%8==4 && y%8==4)
+            if ((state->cellstate[csx+csy*(w+2)] & FLAG_ERROR)>0) ret |= FLAG_ERROR;
+        if ((x%8==4 || y%8==4) && (ret & FLAG_PATH)>0) ret |= cellerror;
+
+    }
+
+    return ret;
+}
+
+static void redraw_tile(drawing *dr, game_drawstate *ds,
+                        const game_state *state, const game_ui *ui,
+                        unsigned short flashflag, int i) {
+    unsigned long tile = tile_contents(ds, state, ui, flashflag, i);
+    if (tile != ds->cell[i] || ds->tainted) {
+        ds->cell[i] = tile;
+        draw_cell(dr, ds, i);
+    }
+}
+
+/*
+ * Redraw the tiles belonging to grid cell (cx,cy): its interior, the
+ * four edges around it and their corner points, plus the outer border
+ * strip if the cell is on the edge of the grid. Every tile depends
+ * only on the edges, cell states and cursor of cells whose blocks
+ * contain it.
+ */
+static void redraw_cell_block(drawing *dr, game_drawstate *ds,
+                              const game_state *state, const game_ui *ui,
+                              unsigned short flashflag, int cx, int cy) {
+    int w = state->w, h = state->h;
+    int x, y;
+    int x0 = 8*cx + (cx == 0   ? -2 : 0), x1 = 8*cx + 8 + (cx == w-1 ? 2 : 0);
+    int y0 = 8*cy + (cy == 0   ? -2 : 0), y1 = 8*cy + 8 + (cy == h-1 ? 2 : 0);
+
+    for (y=y0;y<=y1;y++)
+    for (x=x0;x<=x1;x++)
+        redraw_tile(dr, ds, state, ui, flashflag, (x+2)+(y+2)*(8*w+5));
+}
+
 static void game_redraw(drawing *dr, game_drawstate *ds,
                         const game_state *oldstate, const game_state *state,
                         int dir, const game_ui *ui,
                         float animtime, float flashtime) {
-    int i,j,w,h,x,y,cx,cy,csx,csy;
-    unsigned long *newcell;
-    unsigned char cellerror;
+    int i,x,y,w,h,ndrag;
+    bool full;
     bool flash = (bool)((int)(flashtime * 5 / FLASH_TIME) % 2);
     unsigned short flashflag = (flashtime > 0.0 && flash) ? FLAG_FLASH : FLAG_NONE;
     w = state->w; h = state->h;
-    newcell = snewn((8*w+5)*(8*h+5), unsigned long);
-    for (i=0;i<((8*w)+5)*((8*h)+5); i++) newcell[i] = 0x00000000;
 
-    if (ui->ndragcoords > 0)
-        for (i=0;i<ui->ndragcoords;i++)
-            newcell[ui->dragcoords[i]] |= FLAG_DRAG;
-    
-    for (i=0;i<((8*w)+5)*((8*h)+5); i++) {
-        x = i%(8*w+5)-2; y = i/(8*w+5)-2;
-        cx = x/8; cy = y/8;
-        csx = (x<0) ? 0 : cx+1; csy = (y<0) ? 0 : cy+1;
-
-        cellerror = state->cellstate[csx+csy*(w+2)];
-
-        /* Corner border cells. Unused. */
-        if ((x<0 && y<0) || (x<0 && y>8*h) || (x>8*w && y<0) || (x>8*w && y>8*h)) {}
-
-        /* Left / Right border cells */
-        else if (x<0 || x>8*w) {
-            if (y%8==4 && x==-1)
-                newcell[i] |= flashflag|(state->edge_v[cy*(w+1)]   & (FLAG_PATH|cellerror));
-            if (y%8==4 && x==8*w+1)
-                newcell[i] |= flashflag|(state->edge_v[w+cy*(w+1)] & (FLAG_PATH|cellerror));
-        }
-
-        /* Top / Bottom border cells */
-        else if (y<0 || y>8*h) {
-            if (x%8==4 && y==-1)
-                newcell[i] |= flashflag|(state->edge_h[cx]         & (FLAG_PATH|cellerror));
-            if (x%8==4 && y==8*h+1)
-                newcell[i] |= flashflag|(state->edge_h[cx+h*w]     & (FLAG_PATH|cellerror));
-        }
-
-        /* 4-Corner cells */
-        else if ((x%8 == 0) && (y%8 == 0)) {
-            if (ui->show_grid) {
-                if (cx>0 && cy>0)
-                    newcell[i] |= CURSOR(cx-1,cy-1) ? 0x0300 : 
-                                  parity(cx-1,cy-1) ? 0x0100 : 0x0200;
-                if (cx>0 && cy<h)
-                    newcell[i] |= CURSOR(cx-1,cy)   ? 0x0c00 :
-                                  parity(cx-1,cy)   ? 0x0400 : 0x0800;
-                if (cx<w && cy>0)
-                    newcell[i] |= CURSOR(cx,cy-1)   ? 0x3000 :
-                                  parity(cx,cy-1)   ? 0x1000 : 0x2000;
-                if (cx<w && cy<h)
-                    newcell[i] |= CURSOR(cx,cy)     ? 0xc000 :
-                                  parity(cx,cy)     ? 0x4000 : 0x8000;
-            }
-            if (cx > 0) newcell[i] |= state->edge_h[(cx-1)+cy*w]     & (FLAG_WALL | FLAG_FIXED);
-            if (cx < w) newcell[i] |= state->edge_h[cx+cy*w]         & (FLAG_WALL | FLAG_FIXED);
-            if (cy > 0) newcell[i] |= state->edge_v[cx+(cy-1)*(w+1)] & (FLAG_WALL | FLAG_FIXED);
-            if (cy < h) newcell[i] |= state->edge_v[cx+cy*(w+1)]     & (FLAG_WALL | FLAG_FIXED);
-        }
+    /* Move the drag highlight from the tiles last drawn to the new ones */
+    ndrag = ui->ndragcoords > 0 ? ui->ndragcoords : 0;
+    for (i=0;i<ds->ndragcoords;i++) ds->dragmap[ds->dragcoords[i]] = false;
+    for (i=0;i<ndrag;i++) ds->dragmap[ui->dragcoords[i]] = true;
 
-        /* Horizontal edge cells */
-        else if (y%8 == 0) {
-            if (ui->show_grid) {
-                if (cy > 0) newcell[i] |= CURSOR(cx,cy-1) ? 0x3300 : parity(cx,cy-1) ? 0x1100:0x2200;
-                if (cy < h) newcell[i] |= CURSOR(cx,cy)   ? 0xcc00 : parity(cx,cy)   ? 0x4400:0x8800;
-            }
-            newcell[i] |= state->edge_h[cx+cy*w] & (FLAG_WALL|FLAG_FIXED);
-            if (x%8==4) {
-                newcell[i] |= flashflag|(state->edge_h[cx+cy*w] & (FLAG_PATH|FLAG_ERROR));
-                if ((newcell[i] & FLAG_PATH)>0) newcell[i] |= cellerror;
-            }
-        }
+    full = ds->tainted || flashflag != ds->flashflag ||
+           ui->show_grid != ds->show_grid;
 
-        /* Vertical edge cells */
-        else if (x%8 == 0) {
-            if (ui->show_grid) {
-                if (cx > 0) newcell[i] |= CURSOR(cx-1,cy) ? 0x0f00 :
-                                          parity(cx-1,cy) ? 0x0500 : 0x0a00;
-                if (cx < w) newcell[i] |= CURSOR(cx,cy)   ? 0xf000 :
-                                          parity(cx,cy)   ? 0x5000 : 0xa000;
-            }
-            newcell[i] |= state->edge_v[cx+cy*(w+1)] & (FLAG_WALL|FLAG_FIXED);
-            if (y%8==4) {
-                newcell[i] |= flashflag|(state->edge_v[cx+cy*(w+1)] & (FLAG_PATH|FLAG_ERROR));
-                if ((newcell[i] & FLAG_PATH)>0) newcell[i] |= cellerror;
-            }
+    if (full) {
+        for (i=0;i<((8*w)+5)*((8*h)+5); i++)
+            redraw_tile(dr, ds, state, ui, flashflag, i);
+    }
+    else {
+        for (i=0;i<ds->ndragcoords;i++)
+            redraw_tile(dr, ds, state, ui, flashflag, ds->dragcoords[i]);
+        for (i=0;i<ndrag;i++)
+            redraw_tile(dr, ds, state, ui, flashflag, ui->dragcoords[i]);
+
+        if (ui->cursor_active != ds->cursor_active ||
+            ui->curx != ds->curx || ui->cury != ds->cury) {
+            if (ds->cursor_active)
+                redraw_cell_block(dr, ds, state, ui, flashflag, ds->curx, ds->cury);
+            if (ui->cursor_active)
+                redraw_cell_block(dr, ds, state, ui, flashflag, ui->curx, ui->cury);
         }
-        
-        /* Path cells */
-        else {
-            if (ui->show_grid) 
-                for (j=0;j<4;j++) newcell[i] |= (CURSOR(cx,cy) ? 0x03 :
-                                                 parity(cx,cy) ? 0x01:0x02) << (8+2*j);
-            if (x%8==4 && y%8<=4)
-                newcell[i] |= flashflag|(state->edge_h[cx+cy*w]         & (FLAG_PATH|cellerror));
-            if (x%8==4 && y%8>=4)
-                newcell[i] |= flashflag|(state->edge_h[cx+(cy+1)*w]     & (FLAG_PATH|cellerror));
-            if (y%8==4 && x%8<=4)
-                newcell[i] |= flashflag|(state->edge_v[cx+cy*(w+1)]     & (FLAG_PATH|cellerror));
-            if (y%8==4 && x%8>=4)
-                newcell[i] |= flashflag|(state->edge_v[(cx+1)+cy*(w+1)] & (FLAG_PATH|cellerror));
-            if (x%8==4 && y%8==4)
-                if ((state->cellstate[csx+csy*(w+2)] & FLAG_ERROR)>0) newcell[i] |= FLAG_ERROR;
-            if ((x%8==4 || y%8==4) && (newcell[i] & FLAG_PATH)>0) newcell[i] |= cellerror;
 
+        for (i=0;i<w*(h+1);i++) {
+            if (state->edge_h[i] == ds->edge_h[i]) continue;
+            x = i%w; y = i/w;
+            if (y > 0) redraw_cell_block(dr, ds, state, ui, flashflag, x, y-1);
+            if (y < h) redraw_cell_block(dr, ds, state, ui, flashflag, x, y);
         }
-    }
-    for (i=0;i<((8*w)+5)*((8*h)+5); i++) {
-        if (newcell[i] != ds->cell[i] || ds->tainted) {
-            ds->cell[i] = newcell[i];
-            draw_cell(dr, ds, i);
+        for (i=0;i<(w+1)*h;i++) {
+            if (state->edge_v[i] == ds->edge_v[i]) continue;
+            x = i%(w+1); y = i/(w+1);
+            if (x > 0) redraw_cell_block(dr, ds, state, ui, flashflag, x-1, y);
+            if (x < w) redraw_cell_block(dr, ds, state, ui, flashflag, x, y);
+        }
+        for (i=0;i<(w+2)*(h+2);i++) {
+            if (state->cellstate[i] == ds->cellstate[i]) continue;
+            x = max(0, min(w-1, i%(w+2)-1));
+            y = max(0, min(h-1, i/(w+2)-1));
+            redraw_cell_block(dr, ds, state, ui, flashflag, x, y);
         }
     }
+
+    memcpy(ds->dragcoords, ui->dragcoords, ndrag*sizeof(int));
+    ds->ndragcoords = ndrag;
+    memcpy(ds->edge_h, state->edge_h, w*(h+1)*sizeof(unsigned char));
+    memcpy(ds->edge_v, state->edge_v, (w+1)*h*sizeof(unsigned char));
+    memcpy(ds->cellstate, state->cellstate, (w+2)*(h+2)*sizeof(unsigned char));
+    ds->curx = ui->curx;
+    ds->cury = ui->cury;
+    ds->cursor_active = ui->cursor_active;
+    ds->show_grid = ui->show_grid;
+    ds->flashflag = flashflag;
     ds->tainted = false;
-    sfree(newcell);
 }
 
 static float game_anim_length(const game_state *oldstate,
@@ -2255,49 +2589,212 @@ const struct game thegame = {
     REQUIRE_RBUTTON,       /* flags */
 };
 
-#ifdef DEVELOP
+#ifdef STANDALONE_SOLVER
 
-#include <time.h>
+/*
+ * Check a freshly generated puzzle: it must solve at its own
+ * difficulty to a valid grid, and not at the one below.
+ */
+static const char *check_generated(const game_params *p, const char *desc,
+                                   struct solver_scratch *scratch) {
+    game_state *state = new_game(NULL, p, desc);
+    const char *err = NULL;
+
+    if (walls_solve(state, scratch, p->difficulty, false) != SOLVED ||
+        check_solution(state, true) != SOLVED)
+        err = "does not solve at its difficulty";
+    free_state(state);
+    if (!err && p->difficulty > DIFF_EASY) {
+        state = new_game(NULL, p, desc);
+        if (walls_solve(state, scratch, p->difficulty-1, false) == SOLVED)
+            err = "solves at a lower difficulty";
+        free_state(state);
+    }
+    return err;
+}
 
-static void print_grid(const game_state *state) {
-    char *grid;
-    grid = game_text_format(state);
-    printf("%s", grid);
-    sfree(grid);
+static void add_solve_stats(struct walls_solve_stats *to,
+                            const struct walls_solve_stats *from) {
+    int i;
+    to->solves += from->solves;
+    to->check_solution_calls += from->check_solution_calls;
+    for (i=0;i<NPASSES;i++) {
+        to->pass[i].invocations += from->pass[i].invocations;
+        to->pass[i].deductions += from->pass[i].deductions;
+        to->pass[i].ns += from->pass[i].ns;
+    }
+}
+
+static void add_stats(struct walls_stats *to, const struct walls_stats *from) {
+    to->attempts += from->attempts;
+    to->too_easy += from->too_easy;
+    add_solve_stats(&to->gen, &from->gen);
+    add_solve_stats(&to->puzzle, &from->puzzle);
+}
+
+/* One line of per-pass deduction counts for a single puzzle. */
+static void print_grade(const struct walls_solve_stats *st) {
+    int i;
+    printf("  deductions:");
+    for (i=0;i<NPASSES;i++)
+        printf(" %ld", st->pass[i].deductions);
+    printf(" (check_solution %ld)\n", st->check_solution_calls);
+}
+
+static void print_stats(const struct walls_stats *st, int count, double secs) {
+    const struct walls_solve_stats *g = &st->gen;
+    long long passtotal = 0;
+    int i;
+
+    for (i=0;i<NPASSES;i++) passtotal += g->pass[i].ns;
+
+    printf("%d puzzles in %.3fs: %.2f puzzles/sec\n",
+           count, secs, secs > 0 ? count / secs : 0.0);
+    printf("  attempts:        %d (%d rejected as too easy, %.2f per puzzle)\n",
+           st->attempts, st->too_easy,
+           count ? (double)st->too_easy / count : 0.0);
+    printf("  solver calls:    %ld (%.1f per puzzle)\n",
+           g->solves, count ? (double)g->solves / count : 0.0);
+    printf("  check_solution:  %ld (%.1f per puzzle)\n",
+           g->check_solution_calls,
+           count ? (double)g->check_solution_calls / count : 0.0);
+    printf("  %-20s %10s %10s %10s %6s %12s\n", "pass", "runs",
+           "deduced", "ms", "time", "per puzzle");
+    for (i=0;i<NPASSES;i++)
+        printf("  %-20s %10ld %10ld %10.1f %5.1f%% %12.2f\n",
+               walls_passnames[i],
+               g->pass[i].invocations, g->pass[i].deductions,
+               g->pass[i].ns / 1e6,
+               passtotal > 0 ? 100.0 * g->pass[i].ns / passtotal : 0.0,
+               count ? (double)st->puzzle.pass[i].deductions / count : 0.0);
 }
 
 int main(int argc, char **argv) {
     game_params *p;
     random_state *rs;
-    game_state *state;
-    char *desc;
-    int i;
-    int solved;
-    time_t seed = time(NULL);
+    struct walls_stats stats, one;
+    struct solver_scratch *scratch;
+    char *id = NULL, *desc;
+    const char *seed = "walls", *err;
+    const char *progname = argv[0];
+    bool soak = false, quiet = false, grade = false, failed = false;
+    int count = -1, done;
+    double start, secs;
+
+    while (--argc > 0) {
+        char *arg = *++argv;
+        if (!strcmp(arg, "-v")) {
+            solver_verbose = true;
+        } else if (!strcmp(arg, "-q")) {
+            quiet = true;
+        } else if (!strcmp(arg, "--soak")) {
+            soak = true;
+        } else if (!strcmp(arg, "--grade")) {
+            grade = true;
+        } else if (!strcmp(arg, "-n") && argc > 1) {
+            count = atoi(*++argv);
+            argc--;
+        } else if (!strcmp(arg, "--seed") && argc > 1) {
+            seed = *++argv;
+            argc--;
+        } else if (!strcmp(arg, "--mix") && argc > 1) {
+            path_mix_factor = atoi(*++argv);
+            argc--;
+        } else if (*arg == '-') {
+            fprintf(stderr, "%s: unrecognised option `%s'\n", progname, arg);
+            return 1;
+        } else {
+            id = arg;
+        }
+    }
 
-    rs = random_new((void*)&seed, sizeof(time_t));
-    /* rs = random_new("123456", 6); */
-    p = default_params();
-    p->w = 8;
-    p->h = 9;
-    p->difficulty = DIFF_HARD;
+    if (!id) {
+        fprintf(stderr, "usage: %s [-v] [-q] [--soak] [--grade] [-n count] "
+                "[--seed seed] [--mix factor] <params> | <game_id>\n",
+                progname);
+        fprintf(stderr, "  e.g. %s -n 20 9x9dh\n", progname);
+        return 1;
+    }
 
-    for (i=0;i<10;i++) {
-        desc = new_game_desc(p, rs, NULL, 0);
-        state = new_game(NULL, p, desc);
-        walls_solve(state, DIFF_HARD, false);
-        print_grid(state);
-        solved = check_solution(state, true);
-        printf("Solved: %s\n", solved == 0 ? "SOLVED" : solved == 1 ? "INVALID" : "AMBIGUOUS");
+    p = default_params();
+    desc = strchr(id, ':');
+    if (desc)
+        *desc++ = '\0';
+    decode_params(p, id);
+    err = validate_params(p, true);
+    if (err) {
+        fprintf(stderr, "%s: %s\n", progname, err);
+        return 1;
+    }
+
+    if (desc) {
+        game_state *state = new_game(NULL, p, desc);
+        char *text;
+        int ret;
+
+        scratch = new_scratch(p->w, p->h);
+        ret = walls_solve(state, scratch, p->difficulty, solver_verbose);
+        free_scratch(scratch);
+        text = game_text_format(state);
+        fputs(text, stdout);
+        sfree(text);
+        printf("%s\n", ret == SOLVED ? "Solved" : ret == INVALID ?
+               "Invalid" : "Not solved at this difficulty");
         free_state(state);
+        free_params(p);
+        return ret == SOLVED ? 0 : 1;
+    }
+
+    /*
+     * Generate 'count' puzzles (one by default), printing them unless
+     * -q is given, then the generation statistics. --grade adds each
+     * puzzle's per-pass deduction counts. In soak mode the
+     * puzzles are checked instead of printed, and generation keeps
+     * going until 'count' is reached (forever by default) or a puzzle
+     * fails its check.
+     */
+    if (count < 0) count = soak ? 0 : 1;
+    memset(&stats, 0, sizeof(stats));
+    scratch = new_scratch(p->w, p->h);
+    id = encode_params(p, true);
+    rs = random_new(seed, strlen(seed));
+    start = walls_timer_ns() / 1e9;
+
+    for (done = 0; count == 0 || done < count; done++) {
+        memset(&one, 0, sizeof(one));
+        desc = generate_desc(p, rs, &one);
+        add_stats(&stats, &one);
+        if (!quiet && !soak) {
+            printf("%s:%s\n", id, desc);
+            if (grade) print_grade(&one.puzzle);
+        }
+        if (soak) {
+            err = check_generated(p, desc, scratch);
+            if (err) {
+                printf("%s:%s %s\n", id, desc, err);
+                failed = true;
+                sfree(desc);
+                done++;
+                break;
+            }
+            if ((done+1) % 100 == 0) {
+                secs = walls_timer_ns() / 1e9 - start;
+                printf("%d puzzles ok, %.2f puzzles/sec\n",
+                       done+1, secs > 0 ? (done+1) / secs : 0.0);
+                fflush(stdout);
+            }
+        }
         sfree(desc);
-        if (solved != 0) break;
     }
+    secs = walls_timer_ns() / 1e9 - start;
 
+    print_stats(&stats, done, secs);
+
+    free_scratch(scratch);
     random_free(rs);
+    sfree(id);
     free_params(p);
-    return 0;
+    return failed ? 1 : 0;
 }
 
 #endif
-